@@ -0,0 +1,286 @@
+#include "asset_cache.h"
+
+#include <SDL.h>
+#include <SDL_image.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define CACHE_SUFFIX ".cache"
+
+// =====================================================
+// =============== FILE HELPERS
+// =====================================================
+
+#ifdef _WIN32
+bool map_file(const char *path, mapped_file *file)
+{
+    memset(file, 0, sizeof(*file));
+
+    HANDLE fh = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (fh == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(fh, &size) || size.QuadPart == 0)
+    {
+        CloseHandle(fh);
+        return false;
+    }
+
+    HANDLE mh = CreateFileMappingA(fh, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mh == NULL)
+    {
+        CloseHandle(fh);
+        return false;
+    }
+
+    void *data = MapViewOfFile(mh, FILE_MAP_READ, 0, 0, 0);
+    if (data == NULL)
+    {
+        CloseHandle(mh);
+        CloseHandle(fh);
+        return false;
+    }
+
+    file->data = data;
+    file->size = (size_t)size.QuadPart;
+    file->file_handle = fh;
+    file->mapping_handle = mh;
+    return true;
+}
+
+void unmap_file(mapped_file *file)
+{
+    if (file->data != NULL) UnmapViewOfFile(file->data);
+    if (file->mapping_handle != NULL) CloseHandle(file->mapping_handle);
+    if (file->file_handle != NULL) CloseHandle(file->file_handle);
+    memset(file, 0, sizeof(*file));
+}
+#else
+bool map_file(const char *path, mapped_file *file)
+{
+    memset(file, 0, sizeof(*file));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // mapping stays valid after closing the descriptor
+    if (data == MAP_FAILED) return false;
+
+    file->data = data;
+    file->size = (size_t)st.st_size;
+    return true;
+}
+
+void unmap_file(mapped_file *file)
+{
+    if (file->data != NULL) munmap(file->data, file->size);
+    memset(file, 0, sizeof(*file));
+}
+#endif
+
+uint64_t hash_bytes(const void *data, size_t size, uint64_t hash)
+{
+    const unsigned char *bytes = data;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+bool write_file_atomic(const char *path, const void *data, size_t size)
+{
+    size_t path_len = strlen(path);
+    char *tmp_file = malloc(path_len + 5);
+    memcpy(tmp_file, path, path_len);
+    memcpy(tmp_file + path_len, ".tmp", 5);
+
+    bool ok = false;
+    SDL_RWops *out = SDL_RWFromFile(tmp_file, "wb");
+    if (out != NULL)
+    {
+        ok = SDL_RWwrite(out, data, size, 1) == 1;
+        ok = SDL_RWclose(out) == 0 && ok;
+    }
+
+    if (ok)
+    {
+        remove(path);
+        ok = rename(tmp_file, path) == 0;
+    }
+    if (!ok)
+    {
+        printf("Warning: Could not write '%s'\n", path);
+        remove(tmp_file);
+    }
+
+    free(tmp_file);
+    return ok;
+}
+
+// =====================================================
+// =============== CACHE BUILDING
+// =====================================================
+
+// Glyph layout of the exported font bitmap:
+// 16x8 cells starting at ' ', glyph occupies the left half of its cell
+static void build_glyph_table(glyph_uv *glyphs)
+{
+    const int CELLS_PER_ROW = 16;
+    const int CELLS_PER_COLUMN = 8;
+    const float CELL_WIDTH_UV = 1.0f / CELLS_PER_ROW / 2.f;
+    const float CELL_HEIGHT_UV = 1.0f / CELLS_PER_COLUMN;
+
+    memset(glyphs, 0, ASSET_CACHE_GLYPHS * sizeof(glyph_uv));
+    for (int c = ' '; c < ASSET_CACHE_GLYPHS; c++)
+    {
+        int cell = c - ' ';
+        glyphs[c].uv = divf2(FLOAT2(cell % CELLS_PER_ROW, cell / CELLS_PER_ROW), FLOAT2(CELLS_PER_ROW, CELLS_PER_COLUMN));
+        glyphs[c].size = FLOAT2(CELL_WIDTH_UV, CELL_HEIGHT_UV);
+    }
+}
+
+static bool cache_is_valid(const mapped_file *cache, uint64_t source_hash, uint64_t source_size)
+{
+    if (cache->size < sizeof(asset_cache_header)) return false;
+
+    const asset_cache_header *header = cache->data;
+    return header->magic == ASSET_CACHE_MAGIC
+        && header->version == ASSET_CACHE_VERSION
+        && header->source_hash == source_hash
+        && header->source_size == source_size
+        && header->n_glyphs == ASSET_CACHE_GLYPHS
+        && header->pixels_offset >= sizeof(asset_cache_header) + ASSET_CACHE_GLYPHS * sizeof(glyph_uv)
+        && header->pixels_size == (uint64_t)header->width * header->height * 4
+        && header->pixels_offset + header->pixels_size <= cache->size;
+}
+
+// Decodes the source image into an in-memory cache blob (header | glyph table | pixels)
+static void *build_cache(const char *bitmap_file, uint64_t source_hash, uint64_t source_size, size_t *blob_size)
+{
+    SDL_Surface *loaded = IMG_Load(bitmap_file);
+    if (loaded == NULL)
+    {
+        printf("Failed to load font bitmap '%s': %s\n", bitmap_file, SDL_GetError());
+        abort();
+    }
+    SDL_Surface *surface = SDL_ConvertSurfaceFormat(loaded, SDL_PIXELFORMAT_RGBA32, 0);
+    SDL_FreeSurface(loaded);
+    if (surface == NULL)
+    {
+        printf("Failed to convert font bitmap '%s': %s\n", bitmap_file, SDL_GetError());
+        abort();
+    }
+
+    asset_cache_header header;
+    memset(&header, 0, sizeof(header));
+    header.magic = ASSET_CACHE_MAGIC;
+    header.version = ASSET_CACHE_VERSION;
+    header.source_hash = source_hash;
+    header.source_size = source_size;
+    header.width = (u32)surface->w;
+    header.height = (u32)surface->h;
+    header.n_glyphs = ASSET_CACHE_GLYPHS;
+    header.pixels_offset = sizeof(header) + ASSET_CACHE_GLYPHS * sizeof(glyph_uv);
+    header.pixels_size = (uint64_t)header.width * header.height * 4;
+
+    *blob_size = header.pixels_offset + (size_t)header.pixels_size;
+    char *blob = malloc(*blob_size);
+    memcpy(blob, &header, sizeof(header));
+    build_glyph_table((glyph_uv *)(blob + sizeof(header)));
+
+    // Rows are copied one by one, the surface pitch may include padding
+    SDL_LockSurface(surface);
+    size_t row_size = (size_t)surface->w * 4;
+    for (int y = 0; y < surface->h; y++)
+    {
+        const char *row = (const char *)surface->pixels + (size_t)y * surface->pitch;
+        memcpy(blob + header.pixels_offset + y * row_size, row, row_size);
+    }
+    SDL_UnlockSurface(surface);
+    SDL_FreeSurface(surface);
+
+    return blob;
+}
+
+// =====================================================
+// =============== PUBLIC API
+// =====================================================
+
+void font_asset_open(font_asset *asset, const char *bitmap_file)
+{
+    memset(asset, 0, sizeof(*asset));
+
+    // Hashing the encoded source is far cheaper than decoding it
+    mapped_file source;
+    if (!map_file(bitmap_file, &source))
+    {
+        printf("Failed to open font bitmap '%s'\n", bitmap_file);
+        abort();
+    }
+    uint64_t source_hash = hash_bytes(source.data, source.size, HASH_SEED);
+    uint64_t source_size = source.size;
+    unmap_file(&source);
+
+    size_t path_len = strlen(bitmap_file);
+    char *cache_file = malloc(path_len + sizeof(CACHE_SUFFIX));
+    memcpy(cache_file, bitmap_file, path_len);
+    memcpy(cache_file + path_len, CACHE_SUFFIX, sizeof(CACHE_SUFFIX));
+
+    if (!map_file(cache_file, &asset->file) || !cache_is_valid(&asset->file, source_hash, source_size))
+    {
+        unmap_file(&asset->file);
+
+        Uint64 start = SDL_GetPerformanceCounter();
+        size_t blob_size;
+        void *blob = build_cache(bitmap_file, source_hash, source_size, &blob_size);
+        write_file_atomic(cache_file, blob, blob_size);
+        float ms = 1000.f * (SDL_GetPerformanceCounter() - start) / (float)SDL_GetPerformanceFrequency();
+        printf("Rebuilt asset cache '%s' (%.2f ms)\n", cache_file, ms);
+
+        // Serve this start from memory, the next one maps the written cache
+        asset->heap_data = blob;
+        asset->file.data = blob;
+        asset->file.size = blob_size;
+    }
+    free(cache_file);
+
+    const asset_cache_header *header = asset->file.data;
+    asset->width = header->width;
+    asset->height = header->height;
+    asset->glyphs = (const glyph_uv *)((const char *)asset->file.data + sizeof(asset_cache_header));
+    asset->pixels = (const char *)asset->file.data + header->pixels_offset;
+}
+
+void font_asset_close(font_asset *asset)
+{
+    if (asset->heap_data != NULL)
+    {
+        free(asset->heap_data);
+    }
+    else
+    {
+        unmap_file(&asset->file);
+    }
+    memset(asset, 0, sizeof(*asset));
+}
@@ -0,0 +1,68 @@
+#ifndef ASSET_CACHE_H
+#define ASSET_CACHE_H
+
+#include "linalg.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+// Pre-baked, GPU-ready font cache.
+// The first start decodes the source image and writes '<source>.cache' next to it,
+// later starts map the cache and upload the pixels directly without decoding.
+// The cache is rebuilt whenever the version or the hash of the source file changes.
+
+#define ASSET_CACHE_MAGIC 0x43443252u // "R2DC"
+#define ASSET_CACHE_VERSION 1
+#define ASSET_CACHE_GLYPHS 128 // one entry per ASCII code
+
+typedef struct {
+    float2 uv;   // top left texture coordinate
+    float2 size; // extent in texture coordinates
+} glyph_uv;
+
+// On-disk layout: header | glyph table | RGBA8 pixels
+typedef struct {
+    u32 magic;
+    u32 version;
+    uint64_t source_hash;
+    uint64_t source_size;
+    u32 width;
+    u32 height;
+    u32 n_glyphs;
+    u32 pixels_offset; // bytes from start of file
+    uint64_t pixels_size;
+} asset_cache_header;
+
+typedef struct {
+    void *data;
+    size_t size;
+#ifdef _WIN32
+    void *file_handle;
+    void *mapping_handle;
+#endif
+} mapped_file;
+
+typedef struct {
+    u32 width;
+    u32 height;
+    const void *pixels;      // RGBA8, points into the mapping
+    const glyph_uv *glyphs;  // ASSET_CACHE_GLYPHS entries, points into the mapping
+    mapped_file file;
+    void *heap_data;         // set instead of a mapping when the cache was just rebuilt
+} font_asset;
+
+bool map_file(const char *path, mapped_file *file);
+void unmap_file(mapped_file *file);
+
+// Writes to a temporary file first so a crash never leaves a half written file behind
+bool write_file_atomic(const char *path, const void *data, size_t size);
+
+// FNV-1a, pass HASH_SEED or a previous hash to chain several buffers
+#define HASH_SEED 14695981039346656037ull
+uint64_t hash_bytes(const void *data, size_t size, uint64_t hash);
+
+// Maps the cache for 'bitmap_file', (re)building it first if it's missing or stale.
+// Aborts if the source image can't be loaded.
+void font_asset_open(font_asset *asset, const char *bitmap_file);
+void font_asset_close(font_asset *asset);
+
+#endif // ASSET_CACHE_H
@@ -0,0 +1,187 @@
+#include "linalg.h"
+#include "gl_utils.h"
+#include "render2d.h"
+#include <SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Renders the same scenes with the GL and the software backend and compares the pixels.
+// Each scene holds one kind of primitive and has its own bound: axis-aligned rects and tilemaps
+// have to match exactly (same fill rule and subpixel snapping), slanted edges may flip a few pixels
+// whose centers are closer than the 1/16 pixel snapping of the rasterizer, bilinear font sampling
+// and shape coverage may differ by a couple of levels.
+// Also reports the throughput of both backends for the scene (informational, never fails).
+
+#define WIDTH 320
+#define HEIGHT 240
+#define N_TIMED_FRAMES 100
+
+typedef void (*scene_func)(void);
+
+typedef struct {
+    const char *name;
+    scene_func draw;
+    int channel_tolerance; // larger differences count as mismatches
+    int max_mismatches;
+} scene;
+
+static tilemap *g_map;
+
+static void scene_rects_ndc()
+{
+    set_coord_mode(COORDS_NDC);
+    clear_screen(FLOAT3(0.1f, 0.1f, 0.15f));
+    draw_tilemap(g_map, FLOAT2(-1.f, 1.f), FLOAT2(0.5f, 0.5f));
+    for (int i = 0; i < 8; i++) {
+        float x = -0.4f + i * 0.15f;
+        draw_rect(FLOAT2(x, 0.9f), FLOAT2(0.1f, 0.3f + 0.1f * i), FLOAT3(i / 8.f, 1.f - i / 8.f, 0.5f));
+    }
+}
+
+static void scene_rects_pixels()
+{
+    set_coord_mode(COORDS_PIXELS);
+    clear_screen(WHITE);
+    draw_rect(FLOAT2(10.f, 10.f), FLOAT2(100.f, 40.f), GREEN);
+    draw_rect(FLOAT2(120.5f, 10.f), FLOAT2(60.f, 60.f), BLUE);
+    draw_rect(FLOAT2(10.25f, 60.75f), FLOAT2(33.3f, 17.6f), RED);
+    draw_tilemap(g_map, FLOAT2(200.f, 100.f), FLOAT2(100.f, 100.f));
+}
+
+static void scene_tilemaps()
+{
+    set_coord_mode(COORDS_PIXELS);
+    clear_screen(WHITE);
+    for (int i = 0; i < 16; i++) tilemap_set(g_map, INT2(i % 4, i / 4), (unsigned char)(i % 4));
+    draw_tilemap(g_map, FLOAT2(10.f, 10.f), FLOAT2(80.f, 80.f));
+    // Each draw shows the cells as they are at the call, also on GL which uploads them to a texture
+    tilemap_set(g_map, INT2(0, 0), 3);
+    draw_tilemap(g_map, FLOAT2(110.f, 10.f), FLOAT2(80.f, 80.f));
+    tilemap_set(g_map, INT2(1, 0), 3);
+}
+
+static void scene_triangles()
+{
+    set_coord_mode(COORDS_NDC);
+    clear_screen(FLOAT3(0.1f, 0.1f, 0.15f));
+    float2 center = FLOAT2(-0.5f, -0.4f);
+    rad angle = DEG(30.f);
+    draw_quad(addf2(rotatef2(FLOAT2(-0.2f, -0.2f), angle), center), addf2(rotatef2(FLOAT2(0.2f, -0.2f), angle), center),
+              addf2(rotatef2(FLOAT2(0.2f, 0.2f), angle), center), addf2(rotatef2(FLOAT2(-0.2f, 0.2f), angle), center), RED);
+    // Vertices far outside of the guard band, clipped instead of moved on both backends
+    float2 far_left = FLOAT2(-20000.f / (WIDTH / 2.f), 0.3f);
+    float2 far_down = FLOAT2(0.7f, -20000.f / (HEIGHT / 2.f));
+    draw_quad(far_left, FLOAT2(0.9f, 0.9f), FLOAT2(0.9f, 0.8f), far_left, BLUE);
+    draw_quad(FLOAT2(0.1f, 0.f), FLOAT2(0.3f, 0.f), far_down, far_down, GREEN);
+}
+
+static void scene_text_ndc()
+{
+    set_coord_mode(COORDS_NDC);
+    clear_screen(FLOAT3(0.1f, 0.1f, 0.15f));
+    draw_text(FLOAT2(-0.95f, -0.75f), 0.08f, WHITE, "Frame 42: 16.7 ms");
+}
+
+static void scene_text_pixels()
+{
+    set_coord_mode(COORDS_PIXELS);
+    clear_screen(WHITE);
+    draw_text(FLOAT2(10.f, 40.f), 16.f, BLACK, "Dashboard 123");
+    draw_text(FLOAT2(10.5f, 80.25f), 24.f, FLOAT3(0.8f, 0.2f, 0.1f), "Pixels 456");
+}
+
+static void scene_shapes()
+{
+    set_coord_mode(COORDS_PIXELS);
+    clear_screen(BLACK);
+    draw_circle(FLOAT2(60.f, 60.f), 40.f, RED);
+    draw_ring(FLOAT2(180.f, 60.f), 40.f, 6.f, GREEN);
+    draw_line(FLOAT2(20.f, 200.f), FLOAT2(300.f, 140.f), 4.f, BLUE);
+    draw_triangle(FLOAT2(240.f, 120.f), FLOAT2(310.f, 230.f), FLOAT2(200.f, 220.f), WHITE);
+}
+
+static void render_scene(render_backend backend, const char *font, scene_func draw, rgba *pixels, float *ms_per_frame)
+{
+    make_window_with_backend(INT2(100, 100), INT2(WIDTH, HEIGHT), "Backend Compare", backend);
+    load_font(font);
+    // The last color is out of range and saturates
+    float3 palette[4] = { BLACK, RED, GREEN, RGB(1.5f, -0.5f, 0.5f) };
+    g_map = tilemap_create(INT2(4, 4), palette, 4);
+    for (int i = 0; i < 16; i++) tilemap_set(g_map, INT2(i % 4, i / 4), (unsigned char)(i % 3));
+
+    draw();
+    read_framebuffer(pixels);
+
+    // Rendering the same frame again must not blend anything twice
+    rgba *again = malloc(WIDTH * HEIGHT * sizeof(rgba));
+    read_framebuffer(again);
+    if (memcmp(pixels, again, WIDTH * HEIGHT * sizeof(rgba)) != 0)
+    {
+        printf("FAIL: second read_framebuffer of the same frame differs\n");
+        exit(1);
+    }
+    free(again);
+
+    Uint64 start = SDL_GetPerformanceCounter();
+    rgba *timed = malloc(WIDTH * HEIGHT * sizeof(rgba));
+    for (int i = 0; i < N_TIMED_FRAMES; i++)
+    {
+        draw();
+        read_framebuffer(timed);
+    }
+    free(timed);
+    *ms_per_frame = 1000.f * (SDL_GetPerformanceCounter() - start) / (float)SDL_GetPerformanceFrequency() / N_TIMED_FRAMES;
+
+    tilemap_destroy(g_map);
+    teardown_window();
+}
+
+static bool compare_scene(const char *font, const scene *sc)
+{
+    rgba *sw = malloc(WIDTH * HEIGHT * sizeof(rgba));
+    rgba *gl = malloc(WIDTH * HEIGHT * sizeof(rgba));
+    float sw_ms, gl_ms;
+    render_scene(RENDER_BACKEND_SOFTWARE, font, sc->draw, sw, &sw_ms);
+    render_scene(RENDER_BACKEND_GL, font, sc->draw, gl, &gl_ms);
+
+    int mismatches = 0;
+    int max_diff = 0;
+    for (int i = 0; i < WIDTH * HEIGHT; i++)
+    {
+        int diff = abs(sw[i].r - gl[i].r);
+        if (abs(sw[i].g - gl[i].g) > diff) diff = abs(sw[i].g - gl[i].g);
+        if (abs(sw[i].b - gl[i].b) > diff) diff = abs(sw[i].b - gl[i].b);
+        if (diff > max_diff) max_diff = diff;
+        if (diff > sc->channel_tolerance) mismatches++;
+    }
+    free(sw);
+    free(gl);
+
+    bool ok = mismatches <= sc->max_mismatches;
+    printf("%s %s: %d pixels differ by more than %d (max %d allowed), max channel diff %d; software %.3f ms/frame, GL %.3f ms/frame\n",
+           ok ? "PASS" : "FAIL", sc->name, mismatches, sc->channel_tolerance, sc->max_mismatches, max_diff, sw_ms, gl_ms);
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *font = argc > 1 ? argv[1] : "../ExportedFont.png";
+    SDL_setenv("RENDER2D_HIDDEN", "1", 1);
+
+    const scene scenes[] = {
+        { "rects_ndc", scene_rects_ndc, 0, 0 },
+        { "rects_pixels", scene_rects_pixels, 0, 0 },
+        { "tilemaps", scene_tilemaps, 0, 0 },
+        { "triangles", scene_triangles, 0, 4 },
+        { "text_ndc", scene_text_ndc, 2, 0 },
+        { "text_pixels", scene_text_pixels, 2, 0 },
+        { "shapes", scene_shapes, 2, 0 },
+    };
+    bool ok = true;
+    for (int i = 0; i < (int)(sizeof(scenes) / sizeof(scenes[0])); i++)
+    {
+        ok &= compare_scene(font, &scenes[i]);
+    }
+    return ok ? 0 : 1;
+}
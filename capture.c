@@ -0,0 +1,433 @@
+#include "capture.h"
+
+#include "render2d.h"
+#include <SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Internal globals / state
+static SDL_RWops *g_capture_file;
+static SDL_atomic_t g_capture_open; // polled by draw list recording on worker threads
+static Uint64 g_capture_start;
+
+// =====================================================
+// =============== RECORDING
+// =====================================================
+
+static void write_bytes(capture_buffer *buf, const void *data, size_t size)
+{
+    if (buf->size + size > buf->capacity)
+    {
+        size_t capacity = buf->capacity ? buf->capacity : 4096;
+        while (capacity < buf->size + size) capacity *= 2;
+        buf->data = realloc(buf->data, capacity);
+        if (buf->data == NULL)
+        {
+            printf("Capture: out of memory\n");
+            abort();
+        }
+        buf->capacity = capacity;
+    }
+    memcpy(buf->data + buf->size, data, size);
+    buf->size += size;
+}
+
+static void write_op(capture_buffer *buf, capture_op op)
+{
+    unsigned char byte = (unsigned char)op;
+    write_bytes(buf, &byte, 1);
+}
+
+void capture_buffer_reset(capture_buffer *buf)
+{
+    buf->size = 0;
+}
+
+void capture_buffer_free(capture_buffer *buf)
+{
+    free(buf->data);
+    memset(buf, 0, sizeof(*buf));
+}
+
+void capture_buffer_append(capture_buffer *dst, const capture_buffer *src)
+{
+    if (src->size > 0) write_bytes(dst, src->data, src->size);
+}
+
+void capture_clear(capture_buffer *buf, float3 col)
+{
+    write_op(buf, CAPTURE_OP_CLEAR);
+    write_bytes(buf, &col, sizeof(col));
+}
+
+void capture_quad(capture_buffer *buf, float2 a, float2 b, float2 c, float2 d, float3 col)
+{
+    float2 points[4] = { a, b, c, d };
+    write_op(buf, CAPTURE_OP_QUAD);
+    write_bytes(buf, points, sizeof(points));
+    write_bytes(buf, &col, sizeof(col));
+}
+
+void capture_text(capture_buffer *buf, float2 pos, float size, float3 col, const char *text)
+{
+    u32 length = (u32)strlen(text);
+    write_op(buf, CAPTURE_OP_TEXT);
+    write_bytes(buf, &pos, sizeof(pos));
+    write_bytes(buf, &size, sizeof(size));
+    write_bytes(buf, &col, sizeof(col));
+    write_bytes(buf, &length, sizeof(length));
+    write_bytes(buf, text, length + 1);
+}
+
+void capture_frame(capture_buffer *buf, float dt)
+{
+    uint64_t time_us = (uint64_t)((SDL_GetPerformanceCounter() - g_capture_start) * 1e6 / SDL_GetPerformanceFrequency());
+    write_op(buf, CAPTURE_OP_FRAME);
+    write_bytes(buf, &dt, sizeof(dt));
+    write_bytes(buf, &time_us, sizeof(time_us));
+}
+
+void capture_coords(capture_buffer *buf, int coords)
+{
+    unsigned char mode = (unsigned char)coords;
+    write_op(buf, CAPTURE_OP_COORDS);
+    write_bytes(buf, &mode, 1);
+}
+
+void capture_tilemap(capture_buffer *buf, u32 id, int2 cells, const float3 *palette, int n_colors,
+                     const unsigned char *states, float2 top_left, float2 size)
+{
+    u32 colors = (u32)n_colors;
+    write_op(buf, CAPTURE_OP_TILEMAP);
+    write_bytes(buf, &id, sizeof(id));
+    write_bytes(buf, &cells, sizeof(cells));
+    write_bytes(buf, &top_left, sizeof(top_left));
+    write_bytes(buf, &size, sizeof(size));
+    write_bytes(buf, &colors, sizeof(colors));
+    write_bytes(buf, palette, colors * sizeof(float3));
+    write_bytes(buf, states, (size_t)cells.x * cells.y);
+}
+
+void capture_triangle(capture_buffer *buf, float2 a, float2 b, float2 c, float3 col)
+{
+    float2 points[3] = { a, b, c };
+    write_op(buf, CAPTURE_OP_TRIANGLE);
+    write_bytes(buf, points, sizeof(points));
+    write_bytes(buf, &col, sizeof(col));
+}
+
+void capture_line(capture_buffer *buf, float2 a, float2 b, float thickness, float3 col)
+{
+    float2 points[2] = { a, b };
+    write_op(buf, CAPTURE_OP_LINE);
+    write_bytes(buf, points, sizeof(points));
+    write_bytes(buf, &thickness, sizeof(thickness));
+    write_bytes(buf, &col, sizeof(col));
+}
+
+void capture_polyline(capture_buffer *buf, const float2 *points, u32 n_points, float thickness, float3 col)
+{
+    write_op(buf, CAPTURE_OP_POLYLINE);
+    write_bytes(buf, &thickness, sizeof(thickness));
+    write_bytes(buf, &col, sizeof(col));
+    write_bytes(buf, &n_points, sizeof(n_points));
+    write_bytes(buf, points, n_points * sizeof(float2));
+}
+
+void capture_circle(capture_buffer *buf, float2 center, float radius, float3 col)
+{
+    write_op(buf, CAPTURE_OP_CIRCLE);
+    write_bytes(buf, &center, sizeof(center));
+    write_bytes(buf, &radius, sizeof(radius));
+    write_bytes(buf, &col, sizeof(col));
+}
+
+void capture_ring(capture_buffer *buf, float2 center, float radius, float thickness, float3 col)
+{
+    write_op(buf, CAPTURE_OP_RING);
+    write_bytes(buf, &center, sizeof(center));
+    write_bytes(buf, &radius, sizeof(radius));
+    write_bytes(buf, &thickness, sizeof(thickness));
+    write_bytes(buf, &col, sizeof(col));
+}
+
+bool capture_file_open(const char *path, int2 window_size)
+{
+    capture_file_close();
+
+    g_capture_file = SDL_RWFromFile(path, "wb");
+    if (g_capture_file == NULL)
+    {
+        printf("Could not open capture file '%s': %s\n", path, SDL_GetError());
+        return false;
+    }
+
+    capture_header header;
+    memset(&header, 0, sizeof(header));
+    header.magic = CAPTURE_MAGIC;
+    header.version = CAPTURE_VERSION;
+    header.window_size = window_size;
+    SDL_RWwrite(g_capture_file, &header, sizeof(header), 1);
+
+    g_capture_start = SDL_GetPerformanceCounter();
+    SDL_AtomicSet(&g_capture_open, 1);
+    printf("Capturing draw calls to '%s'\n", path);
+    return true;
+}
+
+bool capture_file_is_open()
+{
+    return SDL_AtomicGet(&g_capture_open) != 0;
+}
+
+void capture_file_write(capture_buffer *buf)
+{
+    if (g_capture_file != NULL && buf->size > 0)
+    {
+        if (SDL_RWwrite(g_capture_file, buf->data, buf->size, 1) != 1)
+        {
+            printf("Capture: write failed, stopping capture\n");
+            capture_file_close();
+        }
+    }
+    capture_buffer_reset(buf);
+}
+
+void capture_file_close()
+{
+    if (g_capture_file == NULL) return;
+    SDL_AtomicSet(&g_capture_open, 0);
+    SDL_RWclose(g_capture_file);
+    g_capture_file = NULL;
+}
+
+// =====================================================
+// =============== REPLAY
+// =====================================================
+
+static void read_bytes(capture_reader *reader, void *out, size_t size)
+{
+    if (reader->offset + size > reader->file.size)
+    {
+        printf("Capture: truncated op at offset %zu\n", reader->offset);
+        abort();
+    }
+    memcpy(out, (const char *)reader->file.data + reader->offset, size);
+    reader->offset += size;
+}
+
+bool capture_reader_open(capture_reader *reader, const char *path)
+{
+    memset(reader, 0, sizeof(*reader));
+    if (!map_file(path, &reader->file))
+    {
+        printf("Could not open capture file '%s'\n", path);
+        return false;
+    }
+
+    const capture_header *header = reader->file.data;
+    if (reader->file.size < sizeof(*header) || header->magic != CAPTURE_MAGIC
+        || header->version < 1 || header->version > CAPTURE_VERSION)
+    {
+        printf("'%s' is not a capture file or has an unsupported version\n", path);
+        unmap_file(&reader->file);
+        return false;
+    }
+
+    reader->window_size = header->window_size;
+    reader->offset = sizeof(*header);
+    return true;
+}
+
+bool capture_reader_next(capture_reader *reader, capture_cmd *cmd)
+{
+    if (reader->offset >= reader->file.size) return false;
+
+    unsigned char op;
+    read_bytes(reader, &op, 1);
+    cmd->op = (capture_op)op;
+
+    switch (cmd->op)
+    {
+    case CAPTURE_OP_FRAME:
+        read_bytes(reader, &cmd->dt, sizeof(cmd->dt));
+        read_bytes(reader, &cmd->time_us, sizeof(cmd->time_us));
+        break;
+    case CAPTURE_OP_CLEAR:
+        read_bytes(reader, &cmd->col, sizeof(cmd->col));
+        break;
+    case CAPTURE_OP_QUAD:
+        read_bytes(reader, cmd->points, sizeof(cmd->points));
+        read_bytes(reader, &cmd->col, sizeof(cmd->col));
+        break;
+    case CAPTURE_OP_TEXT:
+    {
+        u32 length;
+        read_bytes(reader, &cmd->points[0], sizeof(cmd->points[0]));
+        read_bytes(reader, &cmd->size, sizeof(cmd->size));
+        read_bytes(reader, &cmd->col, sizeof(cmd->col));
+        read_bytes(reader, &length, sizeof(length));
+        cmd->text = (const char *)reader->file.data + reader->offset;
+        if (reader->offset + length + 1 > reader->file.size || cmd->text[length] != '\0')
+        {
+            printf("Capture: corrupt text at offset %zu\n", reader->offset);
+            abort();
+        }
+        reader->offset += length + 1;
+        break;
+    }
+    case CAPTURE_OP_COORDS:
+    {
+        unsigned char mode;
+        read_bytes(reader, &mode, 1);
+        cmd->coords = mode;
+        break;
+    }
+    case CAPTURE_OP_TILEMAP:
+    {
+        u32 n_colors;
+        read_bytes(reader, &cmd->tilemap_id, sizeof(cmd->tilemap_id));
+        read_bytes(reader, &cmd->cells, sizeof(cmd->cells));
+        read_bytes(reader, &cmd->points[0], sizeof(cmd->points[0]));
+        read_bytes(reader, &cmd->points[1], sizeof(cmd->points[1]));
+        read_bytes(reader, &n_colors, sizeof(n_colors));
+        size_t n_cells = (size_t)cmd->cells.x * cmd->cells.y;
+        if (cmd->cells.x <= 0 || cmd->cells.y <= 0 || n_colors == 0 || n_colors > 256
+            || reader->offset + n_colors * sizeof(float3) + n_cells > reader->file.size)
+        {
+            printf("Capture: corrupt tilemap at offset %zu\n", reader->offset);
+            abort();
+        }
+        cmd->n_colors = (int)n_colors;
+        cmd->palette = (const unsigned char *)reader->file.data + reader->offset;
+        reader->offset += n_colors * sizeof(float3);
+        cmd->states = (const unsigned char *)reader->file.data + reader->offset;
+        reader->offset += n_cells;
+        break;
+    }
+    case CAPTURE_OP_TRIANGLE:
+        read_bytes(reader, cmd->points, 3 * sizeof(float2));
+        read_bytes(reader, &cmd->col, sizeof(cmd->col));
+        break;
+    case CAPTURE_OP_LINE:
+        read_bytes(reader, cmd->points, 2 * sizeof(float2));
+        read_bytes(reader, &cmd->thickness, sizeof(cmd->thickness));
+        read_bytes(reader, &cmd->col, sizeof(cmd->col));
+        break;
+    case CAPTURE_OP_POLYLINE:
+        read_bytes(reader, &cmd->thickness, sizeof(cmd->thickness));
+        read_bytes(reader, &cmd->col, sizeof(cmd->col));
+        read_bytes(reader, &cmd->n_points, sizeof(cmd->n_points));
+        if (cmd->n_points > (reader->file.size - reader->offset) / sizeof(float2))
+        {
+            printf("Capture: corrupt polyline at offset %zu\n", reader->offset);
+            abort();
+        }
+        cmd->polyline = (const unsigned char *)reader->file.data + reader->offset;
+        reader->offset += cmd->n_points * sizeof(float2);
+        break;
+    case CAPTURE_OP_CIRCLE:
+        read_bytes(reader, &cmd->points[0], sizeof(cmd->points[0]));
+        read_bytes(reader, &cmd->size, sizeof(cmd->size));
+        read_bytes(reader, &cmd->col, sizeof(cmd->col));
+        break;
+    case CAPTURE_OP_RING:
+        read_bytes(reader, &cmd->points[0], sizeof(cmd->points[0]));
+        read_bytes(reader, &cmd->size, sizeof(cmd->size));
+        read_bytes(reader, &cmd->thickness, sizeof(cmd->thickness));
+        read_bytes(reader, &cmd->col, sizeof(cmd->col));
+        break;
+    default:
+        printf("Capture: unknown op %u at offset %zu\n", op, reader->offset - 1);
+        abort();
+    }
+    return true;
+}
+
+static tilemap *replay_tilemap(capture_reader *reader, const capture_cmd *cmd)
+{
+    for (u32 i = 0; i < reader->n_tilemaps; i++)
+    {
+        if (reader->tilemap_ids[i] == cmd->tilemap_id) return reader->tilemaps[i];
+    }
+
+    float3 palette[256];
+    memcpy(palette, cmd->palette, cmd->n_colors * sizeof(float3));
+    tilemap *map = tilemap_create(cmd->cells, palette, cmd->n_colors);
+
+    reader->tilemaps = realloc(reader->tilemaps, (reader->n_tilemaps + 1) * sizeof(tilemap *));
+    reader->tilemap_ids = realloc(reader->tilemap_ids, (reader->n_tilemaps + 1) * sizeof(u32));
+    reader->tilemaps[reader->n_tilemaps] = map;
+    reader->tilemap_ids[reader->n_tilemaps] = cmd->tilemap_id;
+    reader->n_tilemaps++;
+    return map;
+}
+
+void capture_reader_replay(capture_reader *reader, const capture_cmd *cmd)
+{
+    switch (cmd->op)
+    {
+    case CAPTURE_OP_CLEAR:
+        clear_screen(cmd->col);
+        break;
+    case CAPTURE_OP_QUAD:
+        draw_quad(cmd->points[0], cmd->points[1], cmd->points[2], cmd->points[3], cmd->col);
+        break;
+    case CAPTURE_OP_TEXT:
+        draw_text(cmd->points[0], cmd->size, cmd->col, cmd->text);
+        break;
+    case CAPTURE_OP_COORDS:
+        set_coord_mode((coord_mode)cmd->coords);
+        break;
+    case CAPTURE_OP_TILEMAP:
+    {
+        // Only changed cells are uploaded, same as in the recorded run
+        tilemap *map = replay_tilemap(reader, cmd);
+        tilemap_update(map, cmd->states);
+        draw_tilemap(map, cmd->points[0], cmd->points[1]);
+        break;
+    }
+    case CAPTURE_OP_TRIANGLE:
+        draw_triangle(cmd->points[0], cmd->points[1], cmd->points[2], cmd->col);
+        break;
+    case CAPTURE_OP_LINE:
+        draw_line(cmd->points[0], cmd->points[1], cmd->thickness, cmd->col);
+        break;
+    case CAPTURE_OP_POLYLINE:
+        if (cmd->n_points > reader->polyline_capacity)
+        {
+            reader->polyline_points = realloc(reader->polyline_points, cmd->n_points * sizeof(float2));
+            reader->polyline_capacity = cmd->n_points;
+        }
+        memcpy(reader->polyline_points, cmd->polyline, cmd->n_points * sizeof(float2));
+        draw_polyline(reader->polyline_points, cmd->n_points, cmd->thickness, cmd->col);
+        break;
+    case CAPTURE_OP_CIRCLE:
+        draw_circle(cmd->points[0], cmd->size, cmd->col);
+        break;
+    case CAPTURE_OP_RING:
+        draw_ring(cmd->points[0], cmd->size, cmd->thickness, cmd->col);
+        break;
+    case CAPTURE_OP_FRAME:
+        break;
+    }
+}
+
+void capture_reader_rewind(capture_reader *reader)
+{
+    reader->offset = sizeof(capture_header);
+}
+
+void capture_reader_close(capture_reader *reader)
+{
+    for (u32 i = 0; i < reader->n_tilemaps; i++)
+    {
+        tilemap_destroy(reader->tilemaps[i]);
+    }
+    free(reader->tilemaps);
+    free(reader->tilemap_ids);
+    free(reader->polyline_points);
+    unmap_file(&reader->file);
+    memset(reader, 0, sizeof(*reader));
+}
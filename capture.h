@@ -0,0 +1,115 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include "asset_cache.h"
+#include "linalg.h"
+#include "render2d.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+// Binary capture of the draw call stream, replayed by the replay tool.
+// Layout: capture_header, then a sequence of ops, each a one byte opcode followed by its
+// arguments as raw little endian values. Every frame ends with CAPTURE_OP_FRAME.
+
+#define CAPTURE_MAGIC 0x52443252u // "R2DR"
+#define CAPTURE_VERSION 4 // 2 added CAPTURE_OP_COORDS, 3 CAPTURE_OP_TILEMAP, 4 the shapes, older files still replay
+
+typedef enum {
+    CAPTURE_OP_FRAME = 1, // float dt, u64 microseconds since capture start
+    CAPTURE_OP_CLEAR,     // float3 col
+    CAPTURE_OP_QUAD,      // float2 a, b, c, d, float3 col
+    CAPTURE_OP_TEXT,      // float2 pos, float size, float3 col, u32 length, text + '\0'
+    CAPTURE_OP_COORDS,    // u8 coord_mode, applies from the frame it is recorded in
+    CAPTURE_OP_TILEMAP,   // u32 id, int2 cells, float2 top_left, size, u32 n_colors, float3 palette[n_colors],
+                          // u8 states[cells.x * cells.y]
+    CAPTURE_OP_TRIANGLE,  // float2 a, b, c, float3 col
+    CAPTURE_OP_LINE,      // float2 a, b, float thickness, float3 col
+    CAPTURE_OP_POLYLINE,  // float thickness, float3 col, u32 n_points, float2 points[n_points]
+    CAPTURE_OP_CIRCLE,    // float2 center, float radius, float3 col
+    CAPTURE_OP_RING,      // float2 center, float radius, float thickness, float3 col
+} capture_op;
+
+typedef struct {
+    u32 magic;
+    u32 version;
+    int2 window_size;
+} capture_header;
+
+typedef struct {
+    unsigned char *data;
+    size_t size;
+    size_t capacity;
+} capture_buffer;
+
+void capture_buffer_reset(capture_buffer *buf);
+void capture_buffer_free(capture_buffer *buf);
+void capture_buffer_append(capture_buffer *dst, const capture_buffer *src);
+
+void capture_clear(capture_buffer *buf, float3 col);
+void capture_quad(capture_buffer *buf, float2 a, float2 b, float2 c, float2 d, float3 col);
+void capture_text(capture_buffer *buf, float2 pos, float size, float3 col, const char *text);
+void capture_frame(capture_buffer *buf, float dt);
+void capture_coords(capture_buffer *buf, int coords);
+// The id tells replays which draws share one tilemap, so it's only created once
+void capture_tilemap(capture_buffer *buf, u32 id, int2 cells, const float3 *palette, int n_colors,
+                     const unsigned char *states, float2 top_left, float2 size);
+// Shapes are captured with their arguments, so replays draw them like the recorded run did
+void capture_triangle(capture_buffer *buf, float2 a, float2 b, float2 c, float3 col);
+void capture_line(capture_buffer *buf, float2 a, float2 b, float thickness, float3 col);
+void capture_polyline(capture_buffer *buf, const float2 *points, u32 n_points, float thickness, float3 col);
+void capture_circle(capture_buffer *buf, float2 center, float radius, float3 col);
+void capture_ring(capture_buffer *buf, float2 center, float radius, float thickness, float3 col);
+
+// Only one capture file can be open at a time
+bool capture_file_open(const char *path, int2 window_size);
+// Safe to call from any thread
+bool capture_file_is_open();
+// Appends the buffer to the file and resets it
+void capture_file_write(capture_buffer *buf);
+void capture_file_close();
+
+typedef struct {
+    capture_op op;
+    float dt;
+    uint64_t time_us;
+    float2 points[4];
+    float size;       // text size, circle and ring radius
+    float thickness;  // lines, polylines and rings
+    float3 col;
+    const char *text; // points into the mapped capture, '\0' terminated
+    int coords;       // coord_mode
+    // CAPTURE_OP_TILEMAP, top_left and size are points[0] and points[1]
+    u32 tilemap_id;
+    int2 cells;
+    int n_colors;
+    const unsigned char *palette; // n_colors float3, points into the mapped capture (unaligned)
+    const unsigned char *states;  // points into the mapped capture
+    // CAPTURE_OP_POLYLINE
+    u32 n_points;
+    const unsigned char *polyline; // n_points float2, points into the mapped capture (unaligned)
+} capture_cmd;
+
+typedef struct {
+    mapped_file file;
+    size_t offset;
+    int2 window_size;
+    // Created by capture_reader_replay on first use, indexed like tilemap_ids
+    tilemap **tilemaps;
+    u32 *tilemap_ids;
+    u32 n_tilemaps;
+    // Aligned copy of the points of a replayed polyline
+    float2 *polyline_points;
+    u32 polyline_capacity;
+} capture_reader;
+
+bool capture_reader_open(capture_reader *reader, const char *path);
+// Returns false at the end of the capture, aborts on corrupt data
+bool capture_reader_next(capture_reader *reader, capture_cmd *cmd);
+// Issues the draw call of a command through render2d, presenting on CAPTURE_OP_FRAME is up to the caller
+void capture_reader_replay(capture_reader *reader, const capture_cmd *cmd);
+// Restart at the first op
+void capture_reader_rewind(capture_reader *reader);
+// Also destroys the replayed tilemaps, call before teardown_window
+void capture_reader_close(capture_reader *reader);
+
+#endif // CAPTURE_H
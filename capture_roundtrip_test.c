@@ -0,0 +1,165 @@
+#include "linalg.h"
+#include "capture.h"
+#include "gl_utils.h"
+#include "render2d.h"
+#include <SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Captures a few frames of main_loop, replays the capture and expects every replayed frame
+// to match the recorded one pixel for pixel.
+// Usage: captureRoundtripTest <font> [--software]
+
+#define WIDTH 320
+#define HEIGHT 240
+#define N_FRAMES 8
+#define CAPTURE_PATH "capture_roundtrip.r2dc"
+
+static rgba *g_recorded[N_FRAMES];
+static int g_frame = 0;
+static draw_list *g_list;
+static tilemap *g_map;
+
+// Grid of 8 pixel cells in both coordinate modes, y grows upwards in NDC
+static float2 shape_point(float x, float y)
+{
+    if (get_coord_mode() == COORDS_NDC) return FLOAT2(-0.8f + x * 0.05f, -0.2f + y * 0.05f);
+    return FLOAT2(30.f + x * 8.f, 150.f - y * 8.f);
+}
+
+static void draw_scene(int frame)
+{
+    // The mode switches mid capture, so CAPTURE_OP_COORDS has to replay too
+    set_coord_mode(frame < N_FRAMES / 2 ? COORDS_NDC : COORDS_PIXELS);
+    clear_screen(FLOAT3(0.1f * frame / N_FRAMES, 0.1f, 0.2f));
+
+    if (get_coord_mode() == COORDS_NDC)
+    {
+        // Enough quads to need more than the initial GL buffers
+        for (int i = 0; i < 400; i++)
+        {
+            float x = -1.f + (i % 20) * 0.1f;
+            float y = 1.f - (i / 20) * 0.1f;
+            draw_rect(FLOAT2(x, y), FLOAT2(0.08f, 0.08f), FLOAT3((i + frame) % 5 / 4.f, 0.5f, 1.f - i / 400.f));
+        }
+        draw_text(FLOAT2(-0.9f, -0.8f), 0.1f, WHITE, "replay me");
+    }
+    else
+    {
+        draw_rect(FLOAT2(10.f + frame, 10.f), FLOAT2(100.f, 50.f), RED);
+        draw_textf_i(FLOAT2(10.f, 100.f), 16.f, WHITE, "frame %d", frame);
+    }
+
+    // Shapes are captured with their arguments and replay antialiased like the recorded ones
+    draw_triangle(shape_point(0.f, 0.f), shape_point(3.f, 0.f), shape_point(1.5f, 2.f + frame * 0.1f), RGB(1.f, 1.f, 0.f));
+    draw_line(shape_point(4.f, 0.f), shape_point(7.f, 3.f), 3.f, RGB(0.f, 1.f, 1.f));
+    float2 polyline[4] = { shape_point(8.f, 0.f), shape_point(9.f, 3.f), shape_point(10.f, 0.f), shape_point(11.f + frame * 0.2f, 3.f) };
+    draw_polyline(polyline, 4, 2.f, RGB(1.f, 0.f, 1.f));
+    draw_circle(shape_point(13.f, 1.5f), 10.f, RGB(1.f, 0.5f, 0.f));
+    draw_ring(shape_point(16.f, 1.5f), 10.f + frame, 3.f, WHITE);
+
+    // Captured as one op with the cell states, replay creates its own tilemap from it
+    tilemap_set(g_map, INT2(frame % 6, frame / 6), (unsigned char)(1 + frame % 2));
+    draw_tilemap(g_map, get_coord_mode() == COORDS_NDC ? FLOAT2(0.2f, 0.9f) : FLOAT2(220.f, 20.f),
+                 get_coord_mode() == COORDS_NDC ? FLOAT2(0.6f, 0.4f) : FLOAT2(90.f, 60.f));
+
+    // Draw list ops are captured when the list is submitted
+    draw_list_reset(g_list);
+    draw_rect_dl(g_list, get_coord_mode() == COORDS_NDC ? FLOAT2(0.5f, -0.5f) : FLOAT2(200.f, 150.f),
+                 get_coord_mode() == COORDS_NDC ? FLOAT2(0.3f, 0.3f) : FLOAT2(40.f, 40.f), GREEN);
+    submit_draw_list(g_list);
+}
+
+static void tick(float dt)
+{
+    UNUSED(dt);
+    if (g_frame >= N_FRAMES) return;
+
+    draw_scene(g_frame);
+    read_framebuffer(g_recorded[g_frame]);
+    if (++g_frame == N_FRAMES)
+    {
+        SDL_Event quit;
+        memset(&quit, 0, sizeof(quit));
+        quit.type = SDL_QUIT;
+        SDL_PushEvent(&quit);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    const char *font = "../ExportedFont.png";
+    render_backend backend = RENDER_BACKEND_GL;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--software") == 0) backend = RENDER_BACKEND_SOFTWARE;
+        else font = argv[i];
+    }
+    SDL_setenv("RENDER2D_HIDDEN", "1", 1);
+
+    make_window_with_backend(INT2(100, 100), INT2(WIDTH, HEIGHT), "Capture Roundtrip", backend);
+    load_font(font);
+    g_list = draw_list_create();
+    float3 palette[3] = { BLACK, GREEN, BLUE };
+    g_map = tilemap_create(INT2(6, 4), palette, 3);
+    // The drawable is larger than the window on high-DPI displays
+    int2 drawable_size = get_drawable_size();
+    int n_pixels = drawable_size.x * drawable_size.y;
+    for (int i = 0; i < N_FRAMES; i++) g_recorded[i] = malloc(n_pixels * sizeof(rgba));
+
+    start_capture(CAPTURE_PATH);
+    main_loop(tick);
+    stop_capture();
+
+    capture_reader reader;
+    if (!capture_reader_open(&reader, CAPTURE_PATH))
+    {
+        printf("FAIL: capture was not written\n");
+        return 1;
+    }
+
+    rgba *replayed = malloc(n_pixels * sizeof(rgba));
+    int n_frames = 0;
+    int n_failed = 0;
+    capture_cmd cmd;
+    while (capture_reader_next(&reader, &cmd))
+    {
+        capture_reader_replay(&reader, &cmd);
+        if (cmd.op != CAPTURE_OP_FRAME) continue;
+
+        if (n_frames < N_FRAMES)
+        {
+            read_framebuffer(replayed);
+            int mismatches = 0;
+            for (int i = 0; i < n_pixels; i++)
+            {
+                if (memcmp(&replayed[i], &g_recorded[n_frames][i], sizeof(rgba)) != 0) mismatches++;
+            }
+            if (mismatches > 0)
+            {
+                printf("FAIL: frame %d differs in %d pixels\n", n_frames, mismatches);
+                n_failed++;
+            }
+        }
+        render_frame();
+        n_frames++;
+    }
+    capture_reader_close(&reader);
+
+    // main_loop may tick once more after the quit event, that frame is empty
+    if (n_frames < N_FRAMES)
+    {
+        printf("FAIL: captured %d frames, expected %d\n", n_frames, N_FRAMES);
+        n_failed++;
+    }
+    if (n_failed == 0) printf("PASS: %d frames replayed identically\n", N_FRAMES);
+
+    free(replayed);
+    for (int i = 0; i < N_FRAMES; i++) free(g_recorded[i]);
+    tilemap_destroy(g_map);
+    draw_list_destroy(g_list);
+    teardown_window();
+    remove(CAPTURE_PATH);
+    return n_failed == 0 ? 0 : 1;
+}
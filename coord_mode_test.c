@@ -0,0 +1,122 @@
+#include "linalg.h"
+#include "gl_utils.h"
+#include "render2d.h"
+#include <SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Lays out a frame in COORDS_PIXELS anchored to the window edges, resizes the window mid run and
+// expects the last frame to fill the new size, also on high-DPI displays where the drawable is
+// larger than the window. Each frame switches to COORDS_NDC and back between draws. The software
+// framebuffer has to follow the window exactly.
+// Usage: coordModeTest <font> [--software] [--pipelined]
+
+#define WIDTH 320
+#define HEIGHT 240
+#define RESIZED_WIDTH 400
+#define RESIZED_HEIGHT 300
+#define N_FRAMES 8
+#define MARKER 16.f
+
+static int g_frame = 0;
+static int2 g_drawn_size; // window size the last frame was laid out for
+
+static void tick(float dt)
+{
+    UNUSED(dt);
+    if (g_frame >= N_FRAMES) return;
+
+    set_coord_mode(COORDS_PIXELS);
+    clear_screen(BLACK);
+    g_drawn_size = get_window_size();
+    float2 size = FLOAT2((float)g_drawn_size.x, (float)g_drawn_size.y);
+    draw_rect(FLOAT2(0.f, 0.f), FLOAT2(MARKER, MARKER), RED);
+    draw_rect(FLOAT2(size.x - MARKER, size.y - MARKER), FLOAT2(MARKER, MARKER), GREEN);
+    draw_textf_i(FLOAT2(MARKER * 2.f, MARKER * 2.f), 16.f, WHITE, "%d x %d", g_drawn_size.x, g_drawn_size.y);
+
+    // Modes mix within a frame, each draw keeps its own
+    set_coord_mode(COORDS_NDC);
+    draw_rect(FLOAT2(-0.1f, 0.1f), FLOAT2(0.2f, 0.2f), BLUE);
+    set_coord_mode(COORDS_PIXELS);
+    draw_rect(FLOAT2(size.x - MARKER, 0.f), FLOAT2(MARKER, MARKER), BLUE);
+
+    // The new size is seen from the next frame on, this one stays in the old layout
+    if (g_frame == N_FRAMES / 2) set_window_size(INT2(RESIZED_WIDTH, RESIZED_HEIGHT));
+
+    if (++g_frame == N_FRAMES)
+    {
+        SDL_Event quit;
+        memset(&quit, 0, sizeof(quit));
+        quit.type = SDL_QUIT;
+        SDL_PushEvent(&quit);
+    }
+}
+
+static bool expect_pixel(const rgba *pixels, int2 drawable_size, float2 pos, float3 col, const char *name)
+{
+    // pos is in window pixels, the drawable may be scaled on high-DPI displays
+    float scale = drawable_size.x / (float)g_drawn_size.x;
+    int x = (int)(pos.x * scale);
+    int y = (int)(pos.y * scale);
+    rgba p = pixels[y * drawable_size.x + x];
+    rgba expected = { (unsigned char)(col.x * 255.f), (unsigned char)(col.y * 255.f), (unsigned char)(col.z * 255.f), 255 };
+    if (p.r != expected.r || p.g != expected.g || p.b != expected.b)
+    {
+        printf("FAIL: %s at (%d, %d) is %d %d %d, expected %d %d %d\n", name, x, y, p.r, p.g, p.b,
+               expected.r, expected.g, expected.b);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *font = "../ExportedFont.png";
+    render_backend backend = RENDER_BACKEND_GL;
+    bool pipelined = false;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--software") == 0) backend = RENDER_BACKEND_SOFTWARE;
+        else if (strcmp(argv[i], "--pipelined") == 0) pipelined = true;
+        else font = argv[i];
+    }
+    SDL_setenv("RENDER2D_HIDDEN", "1", 1);
+
+    make_window_with_backend(INT2(100, 100), INT2(WIDTH, HEIGHT), "Coord Mode", backend);
+    load_font(font);
+    if (pipelined) main_loop_pipelined(tick);
+    else main_loop(tick);
+
+    // The last frame is still drawn until the next clear_screen
+    int2 drawable_size = get_drawable_size();
+    rgba *pixels = malloc((size_t)drawable_size.x * drawable_size.y * sizeof(rgba));
+    read_framebuffer(pixels);
+
+    bool ok = true;
+    if (g_drawn_size.x != RESIZED_WIDTH || g_drawn_size.y != RESIZED_HEIGHT)
+    {
+        printf("FAIL: last frame was laid out for %d x %d, expected %d x %d\n", g_drawn_size.x, g_drawn_size.y,
+               RESIZED_WIDTH, RESIZED_HEIGHT);
+        ok = false;
+    }
+    if (backend == RENDER_BACKEND_SOFTWARE && (drawable_size.x != g_drawn_size.x || drawable_size.y != g_drawn_size.y))
+    {
+        printf("FAIL: software framebuffer is %d x %d, expected the window size %d x %d\n", drawable_size.x, drawable_size.y,
+               g_drawn_size.x, g_drawn_size.y);
+        ok = false;
+    }
+    float2 size = FLOAT2((float)g_drawn_size.x, (float)g_drawn_size.y);
+    ok &= expect_pixel(pixels, drawable_size, FLOAT2(MARKER / 2.f, MARKER / 2.f), RED, "top left marker");
+    ok &= expect_pixel(pixels, drawable_size, FLOAT2(size.x - MARKER / 2.f, size.y - MARKER / 2.f), GREEN, "bottom right marker");
+    ok &= expect_pixel(pixels, drawable_size, FLOAT2(size.x / 2.f, size.y / 2.f), BLUE, "NDC rect in the center");
+    ok &= expect_pixel(pixels, drawable_size, FLOAT2(size.x - MARKER / 2.f, MARKER / 2.f), BLUE, "top right marker");
+    if (ok)
+    {
+        printf("PASS: window %d x %d, drawable %d x %d\n", g_drawn_size.x, g_drawn_size.y, drawable_size.x, drawable_size.y);
+    }
+
+    free(pixels);
+    teardown_window();
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,152 @@
+#include "linalg.h"
+#include "gl_utils.h"
+#include "render2d.h"
+#include <SDL.h>
+#include <stdio.h>
+
+// Measures how a frame of draw lists scales with the number of recording threads:
+// record (worker threads) + merge (submit_draw_list into the frame packet, main thread)
+// + submit (upload and draw on the render thread of main_loop_pipelined).
+// The recording threads are started once and woken per frame, so thread creation isn't timed.
+
+#define N_QUADS (1 << 20)
+#define N_RUNS 5 // frames per thread count, the best one is reported
+#define MAX_THREADS 16
+
+typedef struct {
+    draw_list *list;
+    int first;
+    int count;
+    float ms; // time spent recording, measured on the worker
+} job;
+
+static draw_list *g_lists[MAX_THREADS];
+static job g_jobs[MAX_THREADS];
+static SDL_Thread *g_workers[MAX_THREADS];
+static SDL_sem *g_start[MAX_THREADS];
+static SDL_sem *g_done;
+static bool g_exit_workers = false;
+static int g_n_threads = 1;
+static int g_run = 0;
+static float g_best_record_ms;
+static float g_best_merge_ms;
+static float g_best_worker_ms;
+static float g_single_ms;
+
+static float ms_since(Uint64 start)
+{
+    return 1000.f * (SDL_GetPerformanceCounter() - start) / (float)SDL_GetPerformanceFrequency();
+}
+
+static void record(job *j)
+{
+    for (int i = j->first; i < j->first + j->count; i++) {
+        float x = (i % 1024) / 512.f - 1.f;
+        float y = (i / 1024 % 1024) / 512.f - 1.f;
+        rad angle = DEG((float)(i % 360));
+        float2 a = addf2(rotatef2(FLOAT2(-0.001f, -0.001f), angle), FLOAT2(x, y));
+        float2 b = addf2(rotatef2(FLOAT2( 0.001f, -0.001f), angle), FLOAT2(x, y));
+        float2 c = addf2(rotatef2(FLOAT2( 0.001f,  0.001f), angle), FLOAT2(x, y));
+        float2 d = addf2(rotatef2(FLOAT2(-0.001f,  0.001f), angle), FLOAT2(x, y));
+        draw_quad_dl(j->list, a, b, c, d, GREEN);
+    }
+}
+
+static int worker(void *arg)
+{
+    int index = (int)(intptr_t)arg;
+    for (;;) {
+        SDL_SemWait(g_start[index]);
+        if (g_exit_workers) return 0;
+        Uint64 start = SDL_GetPerformanceCounter();
+        record(&g_jobs[index]);
+        g_jobs[index].ms = ms_since(start);
+        SDL_SemPost(g_done);
+    }
+}
+
+static void tick(float dt)
+{
+    UNUSED(dt);
+    if (g_n_threads > MAX_THREADS) return;
+
+    clear_screen(BLACK);
+
+    // Reset on the main thread, the lists take the coord mode and window size from it
+    for (int t = 0; t < g_n_threads; t++) {
+        draw_list_reset(g_lists[t]);
+        g_jobs[t].list = g_lists[t];
+        g_jobs[t].first = N_QUADS / g_n_threads * t;
+        g_jobs[t].count = N_QUADS / g_n_threads;
+    }
+    Uint64 record_start = SDL_GetPerformanceCounter();
+    for (int t = 0; t < g_n_threads; t++) {
+        SDL_SemPost(g_start[t]);
+    }
+    for (int t = 0; t < g_n_threads; t++) {
+        SDL_SemWait(g_done);
+    }
+    float record_ms = ms_since(record_start);
+    float worker_ms = 0.f;
+    for (int t = 0; t < g_n_threads; t++) {
+        if (g_jobs[t].ms > worker_ms) worker_ms = g_jobs[t].ms;
+    }
+
+    Uint64 merge_start = SDL_GetPerformanceCounter();
+    for (int t = 0; t < g_n_threads; t++) {
+        submit_draw_list(g_lists[t]);
+    }
+    float merge_ms = ms_since(merge_start);
+
+    if (g_run == 0 || record_ms + merge_ms < g_best_record_ms + g_best_merge_ms) {
+        g_best_record_ms = record_ms;
+        g_best_merge_ms = merge_ms;
+        g_best_worker_ms = worker_ms;
+    }
+    if (++g_run < N_RUNS) return;
+
+    // The render thread runs one frame behind, its smoothed time covers the previous frames
+    frame_timings timings = get_frame_timings();
+    float frame_ms = g_best_record_ms + g_best_merge_ms;
+    if (g_n_threads == 1) g_single_ms = frame_ms;
+    // Slowest worker: the record time without waking the workers up
+    printf("%2d threads: record %8.2f ms (slowest worker %8.2f ms), merge %6.2f ms, submit %7.2f ms, speedup %.2fx\n",
+           g_n_threads, g_best_record_ms, g_best_worker_ms, g_best_merge_ms, timings.render_ms, g_single_ms / frame_ms);
+
+    g_run = 0;
+    g_n_threads *= 2;
+    if (g_n_threads > MAX_THREADS) {
+        SDL_Event quit;
+        memset(&quit, 0, sizeof(quit));
+        quit.type = SDL_QUIT;
+        SDL_PushEvent(&quit);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    UNUSED(argc);
+    UNUSED(argv);
+
+    make_window(INT2(100, 100), INT2(800, 600), "Draw List Bench");
+    g_done = SDL_CreateSemaphore(0);
+    for (int t = 0; t < MAX_THREADS; t++) {
+        g_lists[t] = draw_list_create();
+        g_start[t] = SDL_CreateSemaphore(0);
+        g_workers[t] = SDL_CreateThread(worker, "record", (void *)(intptr_t)t);
+    }
+
+    printf("Recording %d quads, %d CPUs\n", N_QUADS, SDL_GetCPUCount());
+    main_loop_pipelined(tick);
+
+    g_exit_workers = true;
+    for (int t = 0; t < MAX_THREADS; t++) {
+        SDL_SemPost(g_start[t]);
+        SDL_WaitThread(g_workers[t], NULL);
+        SDL_DestroySemaphore(g_start[t]);
+        draw_list_destroy(g_lists[t]);
+    }
+    SDL_DestroySemaphore(g_done);
+    teardown_window();
+    return 0;
+}
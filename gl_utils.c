@@ -1,8 +1,12 @@
 #include "gl_utils.h"
 
+#include "asset_cache.h"
+#include <SDL.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 const char *gl_error_string(GLenum err)
 {
@@ -50,40 +54,362 @@ void raise_gl_error(GLenum err, const char *call, const char *file, int line)
     }
 }
 
-GLuint gl_compile_shader(const char* vertex, const char* fragment, const char* frag_bind)
+// =====================================================
+// =============== DEBUG OUTPUT
+// =====================================================
+
+// Release builds pay for no checks unless asked to, see RENDER2D_GL_CHECK in render2d.c
+#ifdef NDEBUG
+gl_check_level g_gl_check_level = GL_CHECK_OFF;
+#else
+gl_check_level g_gl_check_level = GL_CHECK_CALLBACK;
+#endif
+static bool g_checks_initialized = false;
+static SDL_atomic_t g_debug_errors;
+
+static bool debug_output_supported()
+{
+    return GLEW_KHR_debug || GLEW_VERSION_4_3;
+}
+
+static const char *debug_source_string(GLenum source)
+{
+    switch (source)
+    {
+    case GL_DEBUG_SOURCE_API:             return "API";
+    case GL_DEBUG_SOURCE_WINDOW_SYSTEM:   return "Window System";
+    case GL_DEBUG_SOURCE_SHADER_COMPILER: return "Shader Compiler";
+    case GL_DEBUG_SOURCE_THIRD_PARTY:     return "Third Party";
+    case GL_DEBUG_SOURCE_APPLICATION:     return "Application";
+    default:                              return "Other";
+    }
+}
+
+static const char *debug_type_string(GLenum type)
+{
+    switch (type)
+    {
+    case GL_DEBUG_TYPE_ERROR:               return "Error";
+    case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR: return "Deprecated";
+    case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR:  return "Undefined Behavior";
+    case GL_DEBUG_TYPE_PORTABILITY:         return "Portability";
+    case GL_DEBUG_TYPE_PERFORMANCE:         return "Performance";
+    case GL_DEBUG_TYPE_MARKER:              return "Marker";
+    default:                                return "Other";
+    }
+}
+
+static const char *debug_severity_string(GLenum severity)
+{
+    switch (severity)
+    {
+    case GL_DEBUG_SEVERITY_HIGH:   return "high";
+    case GL_DEBUG_SEVERITY_MEDIUM: return "medium";
+    case GL_DEBUG_SEVERITY_LOW:    return "low";
+    default:                       return "notification";
+    }
+}
+
+// May be called from a driver thread, as GL_DEBUG_OUTPUT_SYNCHRONOUS stays disabled
+static void GLAPIENTRY debug_callback(GLenum source, GLenum type, GLuint id, GLenum severity,
+                                      GLsizei length, const GLchar *message, const void *user)
+{
+    UNUSED(length);
+    UNUSED(user);
+
+    printf("GL %s %s (%s, id %u): %s\n", debug_source_string(source), debug_type_string(type),
+           debug_severity_string(severity), id, message);
+
+    // No call site to blame on this thread, so errors are only counted, see gl_debug_error_count
+    if (type == GL_DEBUG_TYPE_ERROR)
+    {
+        SDL_AtomicAdd(&g_debug_errors, 1);
+        fflush(stdout);
+    }
+}
+
+int gl_debug_error_count()
+{
+    return SDL_AtomicGet(&g_debug_errors);
+}
+
+static void apply_check_level()
+{
+    if (g_gl_check_level == GL_CHECK_CALLBACK && !debug_output_supported())
+    {
+        printf("KHR_debug not supported, GL error checks are off (RENDER2D_GL_CHECK=sync checks every call)\n");
+        g_gl_check_level = GL_CHECK_OFF;
+    }
+
+    if (!debug_output_supported()) return;
+
+    if (g_gl_check_level == GL_CHECK_CALLBACK)
+    {
+        glDebugMessageCallback(debug_callback, NULL);
+        // Notifications are too chatty (buffer placement hints etc.), keep everything else
+        glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, NULL, GL_TRUE);
+        glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DEBUG_SEVERITY_NOTIFICATION, 0, NULL, GL_FALSE);
+        glDisable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+        glEnable(GL_DEBUG_OUTPUT);
+    }
+    else
+    {
+        glDisable(GL_DEBUG_OUTPUT);
+        glDebugMessageCallback(NULL, NULL);
+    }
+}
+
+void gl_set_check_level(gl_check_level level)
+{
+    g_gl_check_level = level;
+    if (g_checks_initialized)
+    {
+        apply_check_level();
+    }
+}
+
+void gl_init_checks()
+{
+    g_checks_initialized = true;
+    // Drop errors raised before checks were set up (e.g. by glewInit with glewExperimental)
+    while (glGetError() != GL_NO_ERROR) {}
+    apply_check_level();
+}
+
+void gl_label(GLenum identifier, GLuint name, const char *label)
+{
+    if (g_checks_initialized && debug_output_supported())
+    {
+        GL_CALL(glObjectLabel(identifier, name, -1, label));
+    }
+}
+
+// =====================================================
+// =============== PROGRAM BINARY CACHE
+// =====================================================
+
+#define PROGRAM_CACHE_MAGIC 0x50443252u // "R2DP"
+#define PROGRAM_CACHE_VERSION 1
+
+typedef struct {
+    u32 magic;
+    u32 version;
+    uint64_t key;
+    u32 binary_format;
+    u32 binary_size;
+} program_cache_header;
+
+// Resolved on first use unless set explicitly, see program_cache_dir
+static const char *g_program_cache_dir = NULL;
+static bool g_program_cache_dir_set = false;
+static char *g_pref_path = NULL;
+
+void gl_set_program_cache_dir(const char *dir)
+{
+    g_program_cache_dir = dir;
+    g_program_cache_dir_set = true;
+}
+
+// Defaults to the per-user pref dir, never the working directory which may be read-only or shared
+static const char *program_cache_dir()
+{
+    if (!g_program_cache_dir_set)
+    {
+        g_pref_path = SDL_GetPrefPath("render2d", "program_cache");
+        g_program_cache_dir = g_pref_path;
+        g_program_cache_dir_set = true;
+        if (g_pref_path == NULL)
+        {
+            printf("No pref path for the program binary cache, caching disabled: %s\n", SDL_GetError());
+        }
+    }
+    return g_program_cache_dir;
+}
+
+static bool program_binaries_supported()
+{
+    GLint n_formats = 0;
+    GL_CALL(glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &n_formats));
+    return n_formats > 0;
+}
+
+static bool binary_format_supported(GLenum format)
+{
+    GLint n_formats = 0;
+    GL_CALL(glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &n_formats));
+    if (n_formats <= 0) return false;
+
+    GLint *formats = malloc(n_formats * sizeof(GLint));
+    GL_CALL(glGetIntegerv(GL_PROGRAM_BINARY_FORMATS, formats));
+    bool supported = false;
+    for (GLint i = 0; i < n_formats; i++)
+    {
+        if ((GLenum)formats[i] == format) supported = true;
+    }
+    free(formats);
+    return supported;
+}
+
+// Binaries are only valid for the driver that produced them, so the driver strings are part of the key
+static uint64_t program_cache_key(const char *vertex, const char *fragment, const char *frag_bind)
+{
+    const GLenum driver_strings[3] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+    uint64_t key = HASH_SEED;
+    for (int i = 0; i < 3; i++)
+    {
+        const char *str = (const char *)GL_CALL(glGetString(driver_strings[i]));
+        if (str != NULL) key = hash_bytes(str, strlen(str) + 1, key);
+    }
+    key = hash_bytes(vertex, strlen(vertex) + 1, key);
+    key = hash_bytes(fragment, strlen(fragment) + 1, key);
+    key = hash_bytes(frag_bind, strlen(frag_bind) + 1, key);
+    return key;
+}
+
+static void program_cache_path(char *buf, size_t size, uint64_t key)
+{
+    // SDL pref paths already end in a separator
+    const char *dir = program_cache_dir();
+    size_t len = strlen(dir);
+    const char *separator = len > 0 && (dir[len - 1] == '/' || dir[len - 1] == '\\') ? "" : "/";
+    snprintf(buf, size, "%s%sprogram_%016llx.bin", dir, separator, (unsigned long long)key);
+}
+
+// Returns 0 if there's no usable binary, the caller falls back to compiling from source
+static GLuint load_program_binary(uint64_t key)
+{
+    char path[1024];
+    program_cache_path(path, sizeof(path), key);
+
+    mapped_file file;
+    if (!map_file(path, &file)) return 0;
+
+    const program_cache_header *header = file.data;
+    if (file.size < sizeof(*header)
+        || header->magic != PROGRAM_CACHE_MAGIC
+        || header->version != PROGRAM_CACHE_VERSION
+        || header->key != key
+        || sizeof(*header) + header->binary_size > file.size
+        || !binary_format_supported(header->binary_format))
+    {
+        unmap_file(&file);
+        return 0;
+    }
+
+    // A driver update may reject the binary even with a matching key. The GL errors that raises are
+    // expected here, so the upload bypasses both check levels and only GL_LINK_STATUS decides
+    bool debug_output = g_checks_initialized && debug_output_supported() && glIsEnabled(GL_DEBUG_OUTPUT);
+    if (debug_output) glDisable(GL_DEBUG_OUTPUT);
+    GLuint program = GL_CALL(glCreateProgram());
+    glProgramBinary(program, header->binary_format, (const char *)file.data + sizeof(*header), header->binary_size);
+    while (glGetError() != GL_NO_ERROR) {}
+    if (debug_output) glEnable(GL_DEBUG_OUTPUT);
+    unmap_file(&file);
+
+    GLint status;
+    GL_CALL(glGetProgramiv(program, GL_LINK_STATUS, &status));
+    if (status != GL_TRUE)
+    {
+        GL_CALL(glDeleteProgram(program));
+        return 0;
+    }
+    return program;
+}
+
+static void store_program_binary(GLuint program, uint64_t key)
+{
+    GLint binary_size = 0;
+    GL_CALL(glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &binary_size));
+    if (binary_size <= 0) return;
+
+    char *blob = malloc(sizeof(program_cache_header) + binary_size);
+    program_cache_header *header = (program_cache_header *)blob;
+    memset(header, 0, sizeof(*header));
+    header->magic = PROGRAM_CACHE_MAGIC;
+    header->version = PROGRAM_CACHE_VERSION;
+    header->key = key;
+
+    GLenum binary_format;
+    GL_CALL(glGetProgramBinary(program, binary_size, NULL, &binary_format, blob + sizeof(*header)));
+    header->binary_format = binary_format;
+    header->binary_size = (u32)binary_size;
+
+    char path[1024];
+    program_cache_path(path, sizeof(path), key);
+    write_file_atomic(path, blob, sizeof(*header) + binary_size);
+    free(blob);
+}
+
+// =====================================================
+// =============== SHADER COMPILATION
+// =====================================================
+
+static void print_shader_log(GLuint shader)
+{
+    GLint log_length = 0;
+    GL_CALL(glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &log_length));
+    if (log_length <= 1) return;
+
+    char *log = malloc(log_length);
+    GL_CALL(glGetShaderInfoLog(shader, log_length, NULL, log));
+    printf("%s\n", log);
+    free(log);
+}
+
+static void print_program_log(GLuint program)
+{
+    GLint log_length = 0;
+    GL_CALL(glGetProgramiv(program, GL_INFO_LOG_LENGTH, &log_length));
+    if (log_length <= 1) return;
+
+    char *log = malloc(log_length);
+    GL_CALL(glGetProgramInfoLog(program, log_length, NULL, log));
+    printf("%s\n", log);
+    free(log);
+}
+
+static GLuint compile_stage(GLenum type, const char *source, const char *name)
 {
-    // Shader Loading
     // 1. Create shader and load source
-    GLuint vertexShader = GL_CALL(glCreateShader(GL_VERTEX_SHADER));
-    GL_CALL(glShaderSource(vertexShader, 1, &vertex, NULL));
+    GLuint shader = GL_CALL(glCreateShader(type));
+    GL_CALL(glShaderSource(shader, 1, &source, NULL));
 
     // 2. Compile shader + check for compiler errors
-    GL_CALL(glCompileShader(vertexShader));
+    GL_CALL(glCompileShader(shader));
     GLint status;
-    GL_CALL(glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &status));
-    if (status == GL_TRUE) printf("Compile Vertex Shader: SUCCESS\n");
-    else
+    GL_CALL(glGetShaderiv(shader, GL_COMPILE_STATUS, &status));
+    if (status != GL_TRUE)
     {
-        char buffer[512];
-        GL_CALL(glGetShaderInfoLog(vertexShader, 512, NULL, buffer));
-        printf("ERROR: Vertex Shader compilation failed:\n%s\n", buffer);
+        printf("ERROR: %s Shader compilation failed:\n", name);
+        print_shader_log(shader);
         abort();
     }
+    return shader;
+}
 
-    // Repeat 1. + 2. for fragment shader
-    GLuint fragmentShader = GL_CALL(glCreateShader(GL_FRAGMENT_SHADER));
-    GL_CALL(glShaderSource(fragmentShader, 1, &fragment, NULL));
-    GL_CALL(glCompileShader(fragmentShader));
-    GL_CALL(glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &status));
-    if (status == GL_TRUE) printf("Compile Fragment Shader: SUCCESS\n");
-    else
+GLuint gl_compile_shader(const char* vertex, const char* fragment, const char* frag_bind)
+{
+    Uint64 start = SDL_GetPerformanceCounter();
+
+    // 0. Try the program binary cache first
+    bool use_cache = program_cache_dir() != NULL && program_binaries_supported();
+    uint64_t key = 0;
+    if (use_cache)
     {
-        char buffer[512];
-        GL_CALL(glGetShaderInfoLog(fragmentShader, 512, NULL, buffer));
-        printf("ERROR: Fragment Shader compilation failed:\n%s\n", buffer);
-        abort();
+        key = program_cache_key(vertex, fragment, frag_bind);
+        GLuint program = load_program_binary(key);
+        if (program != 0)
+        {
+            float ms = 1000.f * (SDL_GetPerformanceCounter() - start) / (float)SDL_GetPerformanceFrequency();
+            printf("Load Shader Program from cache: SUCCESS (%.2f ms)\n", ms);
+            return program;
+        }
     }
 
+    // 1. + 2. Compile vertex and fragment shader
+    GLuint vertexShader = compile_stage(GL_VERTEX_SHADER, vertex, "Vertex");
+    GLuint fragmentShader = compile_stage(GL_FRAGMENT_SHADER, fragment, "Fragment");
+
     // 3. Combine shaders into program
     GLuint program = GL_CALL(glCreateProgram());
     GL_CALL(glAttachShader(program, vertexShader));
@@ -93,13 +419,88 @@ GLuint gl_compile_shader(const char* vertex, const char* fragment, const char* f
     GL_CALL(glBindFragDataLocation(program, 0, frag_bind));
 
     // 5. Link Program
+    if (use_cache)
+    {
+        GL_CALL(glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE));
+    }
     GL_CALL(glLinkProgram(program));
 
-    // 5.1 Check for linking errors (TODO)
+    // 5.1 Check for linking errors
+    GLint status;
+    GL_CALL(glGetProgramiv(program, GL_LINK_STATUS, &status));
+    if (status != GL_TRUE)
+    {
+        printf("ERROR: Shader Program linking failed:\n");
+        print_program_log(program);
+        abort();
+    }
 
     // 5.2 Delete shaders (marked for deletion, deleted on program deletion)
+    GL_CALL(glDetachShader(program, vertexShader));
+    GL_CALL(glDetachShader(program, fragmentShader));
     GL_CALL(glDeleteShader(vertexShader));
     GL_CALL(glDeleteShader(fragmentShader));
 
+    float ms = 1000.f * (SDL_GetPerformanceCounter() - start) / (float)SDL_GetPerformanceFrequency();
+    printf("Compile + Link Shader Program: SUCCESS (%.2f ms)\n", ms);
+
+    // 6. Persist for the next start
+    if (use_cache)
+    {
+        store_program_binary(program, key);
+    }
+
+    return program;
+}
+
+GLuint gl_compile_compute_shader(const char *compute)
+{
+    Uint64 start = SDL_GetPerformanceCounter();
+
+    // Graphics programs never have an empty fragment shader, so the keys can't collide
+    bool use_cache = program_cache_dir() != NULL && program_binaries_supported();
+    uint64_t key = 0;
+    if (use_cache)
+    {
+        key = program_cache_key(compute, "", "");
+        GLuint program = load_program_binary(key);
+        if (program != 0)
+        {
+            float ms = 1000.f * (SDL_GetPerformanceCounter() - start) / (float)SDL_GetPerformanceFrequency();
+            printf("Load Compute Program from cache: SUCCESS (%.2f ms)\n", ms);
+            return program;
+        }
+    }
+
+    GLuint computeShader = compile_stage(GL_COMPUTE_SHADER, compute, "Compute");
+
+    GLuint program = GL_CALL(glCreateProgram());
+    GL_CALL(glAttachShader(program, computeShader));
+    if (use_cache)
+    {
+        GL_CALL(glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE));
+    }
+    GL_CALL(glLinkProgram(program));
+
+    GLint status;
+    GL_CALL(glGetProgramiv(program, GL_LINK_STATUS, &status));
+    if (status != GL_TRUE)
+    {
+        printf("ERROR: Compute Program linking failed:\n");
+        print_program_log(program);
+        abort();
+    }
+
+    GL_CALL(glDetachShader(program, computeShader));
+    GL_CALL(glDeleteShader(computeShader));
+
+    float ms = 1000.f * (SDL_GetPerformanceCounter() - start) / (float)SDL_GetPerformanceFrequency();
+    printf("Compile + Link Compute Program: SUCCESS (%.2f ms)\n", ms);
+
+    if (use_cache)
+    {
+        store_program_binary(program, key);
+    }
+
     return program;
-}
\ No newline at end of file
+}
@@ -6,19 +6,51 @@
 const char *gl_error_string(GLenum error);
 
 void raise_gl_error(GLenum error, const char *call, const char *file, int line);
+
+// Error checking level, can be switched at runtime
+//   GL_CHECK_OFF:      no checks at all
+//   GL_CHECK_CALLBACK: asynchronous KHR_debug callback, logs errors and performance warnings
+//                      without stalling the driver and counts errors (falls back to GL_CHECK_OFF if unsupported)
+//   GL_CHECK_SYNC:     glGetError() after every GL_CALL, pinpoints the failing call but serializes the driver
+// The default is GL_CHECK_CALLBACK, or GL_CHECK_OFF in NDEBUG builds.
+// NO_GL_ERROR_CHECK compiles the per call checks out, GL_CHECK_SYNC then behaves like GL_CHECK_OFF.
+typedef enum {
+    GL_CHECK_OFF,
+    GL_CHECK_CALLBACK,
+    GL_CHECK_SYNC,
+} gl_check_level;
+
+extern gl_check_level g_gl_check_level;
+
+void gl_set_check_level(gl_check_level level);
+// Applies the current check level, call once after the context has been created and glewInit() ran
+void gl_init_checks();
+// Errors reported to the GL_CHECK_CALLBACK callback so far, from any thread
+int gl_debug_error_count();
+// Names an object in debug messages and tools, no-op without KHR_debug
+void gl_label(GLenum identifier, GLuint name, const char *label);
+
 #ifndef NO_GL_ERROR_CHECK
 #define GL_CALL(fnCall) fnCall; \
     do { \
-        GLenum err = glGetError(); \
-        if (err != GL_NO_ERROR) { \
-            raise_gl_error(err, #fnCall, __FILE__, __LINE__); \
+        if (g_gl_check_level == GL_CHECK_SYNC) { \
+            GLenum err = glGetError(); \
+            if (err != GL_NO_ERROR) { \
+                raise_gl_error(err, #fnCall, __FILE__, __LINE__); \
+            } \
         } \
     } while (0)
 #else
 #define GL_CALL(fnCall) fnCall
 #endif
 
+// Compiles + links a program, reusing a driver specific program binary from the cache dir if possible.
+// Aborts with the full info log on compile or link errors.
 GLuint gl_compile_shader(const char *vertex, const char *fragment, const char *frag_bind);
+// Same for a compute program, needs GL 4.3
+GLuint gl_compile_compute_shader(const char *compute);
+// Directory for cached program binaries (default: SDL pref path "render2d/program_cache"), NULL disables the cache
+void gl_set_program_cache_dir(const char *dir);
 
 #define UNUSED(x) ((void)(x))
 
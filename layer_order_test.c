@@ -0,0 +1,139 @@
+#include "linalg.h"
+#include "gl_utils.h"
+#include "render2d.h"
+#include <SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Draws pairs of primitives of different kinds on top of each other and expects the later one
+// to cover the earlier one, whatever the kinds and the backend.
+// Usage: layerOrderTest <font> [--software] [--pipelined]
+
+#define WIDTH 320
+#define HEIGHT 240
+#define N_FRAMES 4
+
+static tilemap *g_map;
+static render_cache *g_panel;
+static int g_frame = 0;
+
+static void tick(float dt)
+{
+    UNUSED(dt);
+    if (g_frame >= N_FRAMES) return;
+
+    set_coord_mode(COORDS_PIXELS);
+    clear_screen(BLACK);
+
+    // Text, then a rect over it
+    draw_text(FLOAT2(10.f, 50.f), 32.f, WHITE, "##");
+    draw_rect(FLOAT2(10.f, 10.f), FLOAT2(60.f, 50.f), RED);
+
+    // Circle, then a rect over its center
+    draw_circle(FLOAT2(120.f, 35.f), 25.f, GREEN);
+    draw_rect(FLOAT2(110.f, 25.f), FLOAT2(20.f, 20.f), BLUE);
+
+    // Rect, then a tilemap over it
+    draw_rect(FLOAT2(170.f, 10.f), FLOAT2(50.f, 50.f), RED);
+    draw_tilemap(g_map, FLOAT2(180.f, 20.f), FLOAT2(30.f, 30.f));
+
+    // Polyline, then a rect over it, then text over the rect
+    float2 line[3] = { FLOAT2(240.f, 35.f), FLOAT2(270.f, 35.f), FLOAT2(300.f, 35.f) };
+    draw_polyline(line, 3, 10.f, GREEN);
+    draw_rect(FLOAT2(260.f, 25.f), FLOAT2(20.f, 20.f), BLUE);
+    draw_rect(FLOAT2(10.f, 100.f), FLOAT2(60.f, 50.f), BLUE);
+    draw_text(FLOAT2(10.f, 150.f), 48.f, WHITE, "#");
+
+    // Cached panel, recorded in the first frame and drawn from its texture after, then a rect over it
+    if (render_cache_begin(g_panel, 1))
+    {
+        draw_rect(FLOAT2(110.f, 100.f), FLOAT2(60.f, 50.f), RED);
+        render_cache_end(g_panel);
+    }
+    draw_render_cache(g_panel);
+    draw_rect(FLOAT2(120.f, 110.f), FLOAT2(20.f, 20.f), BLUE);
+
+    if (++g_frame == N_FRAMES)
+    {
+        SDL_Event quit;
+        memset(&quit, 0, sizeof(quit));
+        quit.type = SDL_QUIT;
+        SDL_PushEvent(&quit);
+    }
+}
+
+// pos in window pixels
+static rgba pixel_at(const rgba *pixels, int2 pos)
+{
+    int2 drawable_size = get_drawable_size();
+    int2 window_size = get_window_size();
+    int x = pos.x * drawable_size.x / window_size.x;
+    int y = pos.y * drawable_size.y / window_size.y;
+    return pixels[y * drawable_size.x + x];
+}
+
+static bool expect_pixel(const rgba *pixels, int2 pos, float3 col, const char *name)
+{
+    rgba p = pixel_at(pixels, pos);
+    rgba expected = { (unsigned char)(col.x * 255.f), (unsigned char)(col.y * 255.f), (unsigned char)(col.z * 255.f), 255 };
+    if (p.r != expected.r || p.g != expected.g || p.b != expected.b)
+    {
+        printf("FAIL: %s at (%d, %d) is %d %d %d, expected %d %d %d\n", name, pos.x, pos.y, p.r, p.g, p.b,
+               expected.r, expected.g, expected.b);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *font = "../ExportedFont.png";
+    render_backend backend = RENDER_BACKEND_GL;
+    bool pipelined = false;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--software") == 0) backend = RENDER_BACKEND_SOFTWARE;
+        else if (strcmp(argv[i], "--pipelined") == 0) pipelined = true;
+        else font = argv[i];
+    }
+    SDL_setenv("RENDER2D_HIDDEN", "1", 1);
+
+    make_window_with_backend(INT2(100, 100), INT2(WIDTH, HEIGHT), "Layer Order", backend);
+    load_font(font);
+    float3 palette[1] = { GREEN };
+    g_map = tilemap_create(INT2(3, 3), palette, 1);
+    g_panel = render_cache_create(FLOAT2(110.f, 100.f), FLOAT2(60.f, 50.f));
+    if (pipelined) main_loop_pipelined(tick);
+    else main_loop(tick);
+
+    // The last frame is still drawn until the next clear_screen
+    int2 drawable_size = get_drawable_size();
+    rgba *pixels = malloc((size_t)drawable_size.x * drawable_size.y * sizeof(rgba));
+    read_framebuffer(pixels);
+
+    bool ok = true;
+    ok &= expect_pixel(pixels, INT2(30, 40), RED, "rect over text");
+    ok &= expect_pixel(pixels, INT2(120, 35), BLUE, "rect over circle");
+    ok &= expect_pixel(pixels, INT2(195, 35), GREEN, "tilemap over rect");
+    ok &= expect_pixel(pixels, INT2(270, 35), BLUE, "rect over polyline");
+    ok &= expect_pixel(pixels, INT2(130, 120), BLUE, "rect over cached panel");
+    ok &= expect_pixel(pixels, INT2(160, 140), RED, "cached panel");
+    // Glyphs are filtered, inside a stroke the text blends with the rect below instead of being hidden by it
+    rgba text = pixel_at(pixels, INT2(28, 114));
+    if (text.r == 0)
+    {
+        printf("FAIL: text over rect at (28, 114) is %d %d %d, expected some white\n", text.r, text.g, text.b);
+        ok = false;
+    }
+    if (ok)
+    {
+        printf("PASS: later draws cover earlier ones\n");
+    }
+
+    free(pixels);
+    render_cache_destroy(g_panel);
+    tilemap_destroy(g_map);
+    teardown_window();
+    return ok ? 0 : 1;
+}
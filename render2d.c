@@ -1,10 +1,14 @@
 #include "render2d.h"
 
+#include "asset_cache.h"
+#include "capture.h"
 #include "gl_utils.h"
+#include "sw_raster.h"
 #define SDL_MAIN_HANDLED
 #include <SDL.h>
 #include <SDL_image.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 #define GL_VERSION_MAJOR 4
 #define GL_VERSION_MINOR 6
@@ -12,6 +16,18 @@
 #define PREALLOC_VERTICES 1024
 #define PREALLOC_INDICES 1024
 
+#define MAX_TILEMAP_DRAWS 64
+#define MAX_TILEMAP_COLORS 256
+
+#define MAX_PARTICLE_DRAWS 16
+#define MAX_PARTICLE_EMITS 32 // per system and frame
+#define PARTICLE_GROUP_SIZE 64
+
+#define MAX_CACHE_DRAWS 64
+
+#define N_FRAME_PACKETS 2 // bounds how far the main thread may run ahead of the render thread
+#define TIMING_SMOOTHING 0.1f
+
 // Internal types
 // typedef struct {
 //     float2 pos;
@@ -34,6 +50,8 @@ typedef struct {
     bool is_indexed;
     u32 n_vertices;
     u32 n_indices;
+    u32 vertex_capacity; // buffers grow on demand, see reserve_triangles
+    u32 index_capacity;
 } render_step;
 
 typedef struct {
@@ -44,44 +62,687 @@ typedef struct {
     glid index_buffer;
     u32 n_vertices;
     u32 n_indices;
+    u32 vertex_capacity; // see reserve_text
+    u32 index_capacity;
+    glyph_uv glyphs[ASSET_CACHE_GLYPHS];
 } text_render_step;
 
+typedef struct {
+    glid shader;
+    glid vao; // empty, the quad is generated from gl_VertexID
+    GLint loc_top_left;
+    GLint loc_size;
+    GLint loc_cells;
+    u32 n_draws;
+    struct {
+        tilemap *map;
+        float2 top_left;
+        float2 size;
+    } draws[MAX_TILEMAP_DRAWS];
+} tilemap_render_step;
+
+// Same layout as the std430 struct in PARTICLE_GLSL
+typedef struct {
+    float2 pos;
+    float2 vel;
+    float3 color_start;
+    float size;
+    float3 color_end;
+    float age;
+    float lifetime; // dead once age >= lifetime, a zeroed particle is dead
+    float pad[3];
+} particle;
+
+// CPU path on GL, one live particle as streamed to the instanced particle shader
+typedef struct {
+    float2 pos;
+    float size;
+    float3 col;
+    float alpha;
+} particle_instance;
+
+typedef struct {
+    particle_emit_params params;
+    u32 first; // slot of the first new particle
+    u32 count;
+    u32 seed;
+} particle_emit;
+
+// Everything the render thread needs to step and draw a system, copied so tick can go on
+typedef struct {
+    particle_system *ps;
+    float dt;
+    particle_update_params update;
+    u32 n_emits;
+    particle_emit emits[MAX_PARTICLE_EMITS];
+    // CPU path, range of the frame's particle instances
+    u32 first_instance;
+    u32 n_instances;
+} particle_draw;
+
+typedef struct {
+    bool gpu;
+    glid emit_shader;
+    glid update_shader;
+    glid shader; // instanced from instance_buffer on the CPU path
+    glid vao;    // empty on the GPU path, quads are generated from gl_VertexID
+    glid instance_buffer;
+    particle_instance *instances;
+    u32 n_instances;
+    u32 instance_capacity;
+    bool instances_uploaded; // see shape_render_step
+    GLint loc_emit_first;
+    GLint loc_emit_count;
+    GLint loc_emit_seed;
+    GLint loc_emit_position;
+    GLint loc_emit_position_spread;
+    GLint loc_emit_velocity;
+    GLint loc_emit_velocity_spread;
+    GLint loc_emit_lifetime;
+    GLint loc_emit_size;
+    GLint loc_emit_color_start;
+    GLint loc_emit_color_end;
+    GLint loc_update_dt;
+    GLint loc_update_gravity;
+    GLint loc_update_drag;
+    u32 n_draws;
+    particle_draw draws[MAX_PARTICLE_DRAWS];
+} particle_render_step;
+
+typedef enum {
+    SHAPE_LINE,     // p0 -> p1, params.x thickness
+    SHAPE_RING,     // center p0, params outer + inner radius, a circle has inner radius 0
+    SHAPE_TRIANGLE, // p0, p1, p2
+} shape_kind; // same values as SW_SHAPE_* of the software rasterizer
+
+// Per instance attributes of the shape shader, positions in NDC, params in pixels
+typedef struct {
+    float2 p0;
+    float2 p1;
+    float2 p2;
+    float2 params;
+    float3 col;
+    u32 kind;
+} shape_instance;
+
+typedef struct {
+    u32 first_point;
+    u32 n_points;
+    float thickness;
+    float3 col;
+} polyline_batch;
+
+typedef struct {
+    glid shader;
+    glid vao;
+    glid instance_buffer;
+    GLint loc_half_size;
+    shape_instance *instances;
+    u32 n_instances;
+    u32 instance_capacity;
+    bool instances_uploaded; // once per render, however many batches draw from the buffer
+
+    // Segment i of a polyline reads points i and i + 1 as instanced attributes
+    glid polyline_shader;
+    glid polyline_vao;
+    glid point_buffer;
+    GLint loc_polyline_half_size;
+    GLint loc_polyline_thickness;
+    GLint loc_polyline_col;
+    float2 *points;
+    u32 n_points;
+    u32 point_capacity;
+    polyline_batch *polylines;
+    u32 n_polylines;
+    u32 polyline_capacity;
+    bool points_uploaded;
+} shape_render_step;
+
+// Counters of the per-frame geometry, see current_frame_mark
+typedef struct {
+    u32 tilemap_draws;
+    u32 triangle_vertices;
+    u32 triangle_indices;
+    u32 shape_instances;
+    u32 polylines;
+    u32 polyline_points;
+    u32 particle_draws;
+    u32 particle_instances;
+    u32 text_vertices;
+    u32 text_indices;
+    u32 cache_draws;
+} frame_mark;
+
+// Draws are rendered in call order, so a later draw covers an earlier one whatever their kinds.
+// Consecutive draws of one kind and coord mode form a batch that is rendered with one draw call
+// per step, in the projection of its mode.
+typedef enum {
+    BATCH_TILEMAPS,
+    BATCH_TRIANGLES,
+    BATCH_SHAPES,
+    BATCH_POLYLINES,
+    BATCH_PARTICLES,
+    BATCH_TEXT,
+    BATCH_CACHES,
+} batch_kind;
+
+// Runs until the start of the next batch
+typedef struct {
+    batch_kind kind;
+    coord_mode coords;
+    frame_mark start;
+} batch;
+
+typedef struct {
+    batch *batches;
+    u32 n_batches;
+    u32 capacity;
+} batch_list;
+
+typedef struct {
+    glid shader;
+    glid vao; // empty, the quad is generated from gl_VertexID
+    GLint loc_rect;
+    size_t memory_used;   // bytes of all cache textures
+    size_t memory_budget; // 0 for unlimited
+    uint64_t clock;           // bumped on every draw_render_cache, for least recently used eviction
+    render_cache **caches;
+    u32 n_caches;
+    u32 cache_capacity;
+    render_cache *recording; // between render_cache_begin and render_cache_end
+    frame_mark recording_start;
+    u32 recording_batches;
+    bool rendering_recording; // cache draws inside a recording blend into a premultiplied texture
+    u32 n_draws;
+    render_cache *draws[MAX_CACHE_DRAWS];
+} cache_render_step;
+
 typedef struct {
     int max_fps;
 } settings;
 
+struct render_cache {
+    float2 top_left;
+    float2 size;
+    // Covered drawable pixels, origin at the bottom left like glViewport
+    int2 pixel_min;
+    int2 pixel_size;
+    // Content is stale after a resize or a coord mode change
+    int2 window_size;
+    int2 drawable_size;
+    coord_mode coords;
+    uint64_t content_hash;
+    bool valid;
+    bool passthrough; // this begin/end pair draws straight into the frame
+    bool animated;    // the content draws particles, passthrough until it changes
+    uint64_t last_used;
+    glid texture;
+    glid framebuffer;
+};
+
+struct particle_system {
+    u32 capacity;
+    u32 cursor; // next slot to spawn into
+    u32 seed;
+    particle_update_params update;
+    u32 n_pending;
+    particle_emit pending[MAX_PARTICLE_EMITS];
+    glid buffer;         // GPU path
+    particle *particles; // CPU path
+};
+
+struct tilemap {
+    u32 id; // tells captured draws of different tilemaps apart
+    int2 cells;
+    unsigned char *states; // CPU copy, row 0 at the top
+    float3 palette[MAX_TILEMAP_COLORS];
+    int n_colors;
+    // Changed cells per row as [dirty_min, dirty_max), empty if min >= max
+    int *dirty_min;
+    int *dirty_max;
+    bool dirty; // any row
+    glid state_texture;
+    glid palette_texture;
+};
+
+// Consecutive draws of one kind in a draw list: triangle or text indices, or particle draws of a frame packet
+typedef struct {
+    batch_kind kind;
+    coord_mode coords;
+    u32 first;
+    u32 count;
+} list_batch;
+
+struct draw_list {
+    // Triangles, same split layout as the triangle vertex buffer
+    float2 *positions;
+    float3 *colors;
+    u32 n_vertices;
+    u32 vertex_capacity;
+    GLuint *indices; // relative to the start of this list
+    u32 n_indices;
+    u32 index_capacity;
+
+    text_vertex *text_vertices;
+    u32 n_text_vertices;
+    u32 text_vertex_capacity;
+    GLuint *text_indices;
+    u32 n_text_indices;
+    u32 text_index_capacity;
+
+    // Call order of the above
+    list_batch *batches;
+    u32 n_batches;
+    u32 batch_capacity;
+
+    // Layout of the recorded draws, taken on the main thread by draw_list_create and draw_list_reset
+    // so recording threads never read the window state
+    coord_mode coords;
+    float dpi_scale;
+
+    capture_buffer ops; // recorded calls while a capture is running
+};
+
+typedef struct {
+    draw_list *list;
+    bool clear;
+    float3 clear_color;
+    u32 n_particle_draws;
+    particle_draw particle_draws[MAX_PARTICLE_DRAWS];
+    particle_instance *particle_instances;
+    u32 n_particle_instances;
+    u32 particle_instance_capacity;
+    // Window of this frame, the render thread applies it when it changes
+    int2 window_size;
+    int2 drawable_size;
+    bool quit;
+} frame_packet;
+
 // Internal functions
 static void do_render();
+static void present();
+static void clear_frame(float3 col);
+static frame_mark current_frame_mark();
+static void update_timing(float *timing, Uint64 start, Uint64 end);
+static void upload_draw_list(const draw_list *list, const frame_packet *packet);
+static void draw_list_append(draw_list *dst, const draw_list *src);
+static void list_add_batch(draw_list *list, batch_kind kind, coord_mode coords, u32 first, u32 count);
+static void end_capture_frame(float dt);
+static void render_particles(const frame_mark *from, const frame_mark *to);
+static void render_shapes(const frame_mark *from, const frame_mark *to);
+static void render_cache_draws(u32 first_draw, u32 end_draw);
+static void render_batches(u32 first_batch, const frame_mark *from, const frame_mark *to);
+static void *grow_array(void *data, u32 *capacity, u32 needed, size_t element_size);
+static void read_check_level_from_env();
+static void update_window_size();
+static void apply_view(int2 window_size, int2 drawable_size, coord_mode coords);
 
 // Internal globals / state
+static render_backend g_backend;
 static SDL_Window* g_window;
+static int2 g_window_size;   // in window coordinates, what COORDS_PIXELS positions refer to
+static int2 g_drawable_size; // in framebuffer pixels, larger than the window on high-DPI displays
+static coord_mode g_coords;
 static SDL_GLContext g_glcontext;
+static SDL_Surface* g_sw_surface; // wraps the software framebuffer for blitting
 static settings g_settings;
 static render_step g_render_triangles;
 static text_render_step g_render_text;
+static tilemap_render_step g_render_tilemaps;
+static particle_render_step g_render_particles;
+static shape_render_step g_render_shapes;
+static cache_render_step g_render_caches;
+static batch_list g_batches;
+static frame_mark g_rendered; // part of the frame already in the back buffer, see do_render
+static u32 g_rendered_batch;  // the batch g_rendered is in
+// Last applied by the thread that renders, see apply_view
+static int2 g_view_window_size;
+static int2 g_view_drawable_size;
+static coord_mode g_view_coords;
+
+// Pipelined rendering, see main_loop_pipelined
+static frame_packet g_packets[N_FRAME_PACKETS];
+static frame_packet *g_record_packet; // set while tick records on the main thread
+static bool g_pipelined; // the GL context lives on the render thread
+static SDL_sem *g_free_packets;
+static SDL_sem *g_ready_packets;
+// Software frames are handed over to the main thread for presenting,
+// SDL window surfaces may only be used from the thread that created the window
+static SDL_mutex *g_sw_present_lock;
+static rgba *g_sw_present_pixels;
+static SDL_Surface *g_sw_present_surface;
+static bool g_sw_present_pending;
+
+static SDL_mutex *g_timings_lock;
+static frame_timings g_timings;
+
+// Calls of the current frame, written out at the end of each frame, main thread only
+static capture_buffer g_capture;
+
+// Maps the current coordinates to NDC on the CPU, render caches measure their pixels with it
+static float2 to_ndc(float2 p)
+{
+    if (g_coords == COORDS_NDC) return p;
+    return FLOAT2(2.f * p.x / g_window_size.x - 1.f, 1.f - 2.f * p.y / g_window_size.y);
+}
+
+// +1 if y points up (NDC), -1 if it points down (pixels)
+static float y_up_in(coord_mode coords)
+{
+    return coords == COORDS_PIXELS ? -1.f : 1.f;
+}
+
+static float y_up()
+{
+    return y_up_in(g_coords);
+}
+
+// Drawable pixels per window coordinate along x, 2 on a typical high-DPI display
+static float dpi_scale()
+{
+    return g_window_size.x > 0 ? (float)g_drawable_size.x / g_window_size.x : 1.f;
+}
+
+// Pixels of one coordinate unit, sizes in pixels go through this for the shape fallbacks
+static float2 pixels_per_unit()
+{
+    if (g_coords == COORDS_PIXELS) return FLOAT2(1.f, 1.f);
+    return FLOAT2(0.5f * g_window_size.x, 0.5f * g_window_size.y);
+}
+
+// Wraps the software framebuffer for blitting, again after a resize reallocated it
+static void update_sw_surface()
+{
+    SDL_FreeSurface(g_sw_surface);
+    g_sw_surface = SDL_CreateRGBSurfaceWithFormatFrom((void *)sw_framebuffer(), g_drawable_size.x, g_drawable_size.y, 32,
+                                                      g_drawable_size.x * sizeof(rgba), SDL_PIXELFORMAT_RGBA32);
+}
+
+static void update_window_size()
+{
+    SDL_GetWindowSize(g_window, &g_window_size.x, &g_window_size.y);
+    if (g_backend == RENDER_BACKEND_GL)
+    {
+        SDL_GL_GetDrawableSize(g_window, &g_drawable_size.x, &g_drawable_size.y);
+    }
+    else
+    {
+        g_drawable_size = g_window_size; // no high-DPI scaling, apply_view reallocates the framebuffer
+    }
+
+    // The pipelined render thread applies the new size with its next packet
+    if (!g_pipelined)
+    {
+        apply_view(g_window_size, g_drawable_size, g_coords);
+        if (g_backend == RENDER_BACKEND_SOFTWARE) update_sw_surface();
+    }
+}
+
+// Scale xy and offset zw that map positions in a coord mode to NDC
+static void view_projection(int2 window_size, coord_mode coords, float projection[4])
+{
+    projection[0] = 1.f;
+    projection[1] = 1.f;
+    projection[2] = 0.f;
+    projection[3] = 0.f;
+    if (coords == COORDS_PIXELS)
+    {
+        projection[0] = 2.f / window_size.x;
+        projection[1] = -2.f / window_size.y;
+        projection[2] = -1.f;
+        projection[3] = 1.f;
+    }
+}
+
+// Viewport and projection uniforms, on the thread that renders. The projection scales and offsets
+// positions into NDC in the vertex shaders (and the software rasterizer), so callers never convert
+// vertices themselves. Batches apply their own mode when they are rendered, see render_batches.
+static void apply_view(int2 window_size, int2 drawable_size, coord_mode coords)
+{
+    g_view_window_size = window_size;
+    g_view_drawable_size = drawable_size;
+    g_view_coords = coords;
+
+    float projection[4];
+    if (g_backend == RENDER_BACKEND_SOFTWARE)
+    {
+        sw_resize(drawable_size.x, drawable_size.y);
+        // Every triangle keeps the slot of its mode, retained ones rasterize again with the new window
+        for (int mode = COORDS_NDC; mode <= COORDS_PIXELS; mode++)
+        {
+            view_projection(window_size, (coord_mode)mode, projection);
+            sw_set_projection((u32)mode, FLOAT2(projection[0], projection[1]), FLOAT2(projection[2], projection[3]));
+        }
+        sw_select_projection((u32)coords);
+        return;
+    }
+
+    view_projection(window_size, coords, projection);
+
+    GL_CALL(glViewport(0, 0, drawable_size.x, drawable_size.y));
+
+    glid programs[6] = {
+        g_render_triangles.shader, g_render_text.shader, g_render_tilemaps.shader,
+        g_render_shapes.shader, g_render_shapes.polyline_shader, g_render_particles.shader,
+    };
+    for (int i = 0; i < 6; i++)
+    {
+        if (programs[i] == 0) continue;
+        GLint loc = GL_CALL(glGetUniformLocation(programs[i], "projection"));
+        GL_CALL(glProgramUniform4fv(programs[i], loc, 1, projection));
+    }
+}
+
+void set_coord_mode(coord_mode coords)
+{
+    if (coords == g_coords) return;
+
+    // Draws keep the mode they were made in, so it can change anywhere in a frame
+    g_coords = coords;
+    if (g_record_packet != NULL)
+    {
+        g_record_packet->list->coords = coords;
+    }
+    if (capture_file_is_open())
+    {
+        capture_coords(&g_capture, coords);
+    }
+    // Before make_window the mode is applied with the first window size
+    bool has_view = g_backend == RENDER_BACKEND_GL ? g_glcontext != NULL : g_window != NULL;
+    if (has_view && !g_pipelined)
+    {
+        apply_view(g_window_size, g_drawable_size, g_coords);
+    }
+}
+
+coord_mode get_coord_mode()
+{
+    return g_coords;
+}
+
+int2 get_window_size()
+{
+    return g_window_size;
+}
+
+void set_window_size(int2 size)
+{
+    // Applied when the size change event arrives, so the current frame keeps its view
+    SDL_SetWindowSize(g_window, size.x, size.y);
+}
+
+int2 get_drawable_size()
+{
+    return g_drawable_size;
+}
+
+static void handle_window_event(const SDL_Event *event)
+{
+    if (event->type == SDL_WINDOWEVENT && event->window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
+    {
+        update_window_size();
+    }
+}
+
+static void read_check_level_from_env()
+{
+    // RENDER2D_GL_CHECK=off|callback|sync overrides the compiled in default
+    const char *env = SDL_getenv("RENDER2D_GL_CHECK");
+    if (env == NULL) return;
+
+    if (strcmp(env, "off") == 0) gl_set_check_level(GL_CHECK_OFF);
+    else if (strcmp(env, "callback") == 0) gl_set_check_level(GL_CHECK_CALLBACK);
+    else if (strcmp(env, "sync") == 0) gl_set_check_level(GL_CHECK_SYNC);
+    else printf("Unknown RENDER2D_GL_CHECK value '%s', expected off, callback or sync\n", env);
+}
+
+// Everything drawn so far in the current frame, the ranges between two marks can be rendered on their own
+static frame_mark current_frame_mark()
+{
+    frame_mark mark;
+    mark.tilemap_draws = g_render_tilemaps.n_draws;
+    mark.triangle_vertices = g_render_triangles.n_vertices;
+    mark.triangle_indices = g_render_triangles.n_indices;
+    mark.shape_instances = g_render_shapes.n_instances;
+    mark.polylines = g_render_shapes.n_polylines;
+    mark.polyline_points = g_render_shapes.n_points;
+    mark.particle_draws = g_render_particles.n_draws;
+    mark.particle_instances = g_render_particles.n_instances;
+    mark.text_vertices = g_render_text.n_vertices;
+    mark.text_indices = g_render_text.n_indices;
+    mark.cache_draws = g_render_caches.n_draws;
+    return mark;
+}
+
+static void render_range(const frame_mark *from, const frame_mark *to)
+{
+    if (to->tilemap_draws > from->tilemap_draws)
+    {
+        GL_CALL(glBindVertexArray(g_render_tilemaps.vao));
+        GL_CALL(glUseProgram(g_render_tilemaps.shader));
+        for (u32 i = from->tilemap_draws; i < to->tilemap_draws; i++)
+        {
+            // Cells were uploaded by draw_tilemap
+            tilemap *map = g_render_tilemaps.draws[i].map;
+            // Units 1 + 2, unit 0 keeps the font texture
+            GL_CALL(glBindTextureUnit(1, map->state_texture));
+            GL_CALL(glBindTextureUnit(2, map->palette_texture));
+            GL_CALL(glUniform2f(g_render_tilemaps.loc_top_left, g_render_tilemaps.draws[i].top_left.x, g_render_tilemaps.draws[i].top_left.y));
+            GL_CALL(glUniform2f(g_render_tilemaps.loc_size, g_render_tilemaps.draws[i].size.x, g_render_tilemaps.draws[i].size.y));
+            GL_CALL(glUniform2i(g_render_tilemaps.loc_cells, map->cells.x, map->cells.y));
+            GL_CALL(glDrawArrays(GL_TRIANGLE_STRIP, 0, 4));
+        }
+    }
+
+    if (to->triangle_indices > from->triangle_indices)
+    {
+        GL_CALL(glBindVertexArray(g_render_triangles.vao));
+        GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, g_render_triangles.vertex_buffer));
+        GL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_render_triangles.index_buffer));
+        GL_CALL(glUseProgram(g_render_triangles.shader));
+        GL_CALL(glDrawElements(GL_TRIANGLES, to->triangle_indices - from->triangle_indices, GL_UNSIGNED_INT,
+                               (void*)(from->triangle_indices * sizeof(GLuint))));
+    }
+
+    render_shapes(from, to);
+    render_particles(from, to);
+
+    if (to->text_indices > from->text_indices)
+    {
+        GL_CALL(glBindVertexArray(g_render_text.vao));
+        GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, g_render_text.vertex_buffer));
+        GL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_render_text.index_buffer));
+        GL_CALL(glUseProgram(g_render_text.shader));
+        GL_CALL(glDrawElements(GL_TRIANGLES, to->text_indices - from->text_indices, GL_UNSIGNED_INT,
+                               (void*)(from->text_indices * sizeof(GLuint))));
+    }
+
+    render_cache_draws(from->cache_draws, to->cache_draws);
+}
+
+static void add_batch(batch_kind kind, coord_mode coords, const frame_mark *start)
+{
+    if (g_batches.n_batches > 0)
+    {
+        const batch *last = &g_batches.batches[g_batches.n_batches - 1];
+        if (last->kind == kind && last->coords == coords) return;
+    }
+
+    g_batches.batches = grow_array(g_batches.batches, &g_batches.capacity, g_batches.n_batches + 1, sizeof(batch));
+    batch *b = &g_batches.batches[g_batches.n_batches++];
+    b->kind = kind;
+    b->coords = coords;
+    b->start = *start;
+}
+
+// Called before a draw adds to the frame, starts a new batch if the previous draw was of another
+// kind or mode
+static void begin_batch(batch_kind kind)
+{
+    frame_mark mark = current_frame_mark();
+    add_batch(kind, g_coords, &mark);
+}
+
+// Renders [from, to) batch by batch, from lies in first_batch. Each range only grows the
+// counters of its batch's kind, so render_range draws exactly that batch.
+static void render_batches(u32 first_batch, const frame_mark *from, const frame_mark *to)
+{
+    for (u32 i = first_batch; i < g_batches.n_batches; i++)
+    {
+        const batch *b = &g_batches.batches[i];
+        if (b->coords != g_view_coords)
+        {
+            apply_view(g_view_window_size, g_view_drawable_size, b->coords);
+        }
+        const frame_mark *start = i == first_batch ? from : &b->start;
+        const frame_mark *end = i + 1 < g_batches.n_batches ? &g_batches.batches[i + 1].start : to;
+        render_range(start, end);
+    }
+}
 
+// Only renders what was drawn since the last call, so read_framebuffer followed by the regular
+// render of the same frame doesn't blend anything twice
 static void do_render()
 {
-    GL_CALL(glBindVertexArray(g_render_triangles.vao));
-    GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, g_render_triangles.vertex_buffer));
-    GL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_render_triangles.index_buffer));
-    GL_CALL(glUseProgram(g_render_triangles.shader));
-    GL_CALL(glDrawElements(GL_TRIANGLES, g_render_triangles.n_indices, GL_UNSIGNED_INT, 0));
+    if (g_backend == RENDER_BACKEND_SOFTWARE)
+    {
+        sw_render();
+        return;
+    }
 
-    GL_CALL(glBindVertexArray(g_render_text.vao));
-    GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, g_render_text.vertex_buffer));
-    GL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_render_text.index_buffer));
-    GL_CALL(glUseProgram(g_render_text.shader));
-    GL_CALL(glDrawElements(GL_TRIANGLES, g_render_text.n_indices, GL_UNSIGNED_INT, 0));
+    frame_mark frame_end = current_frame_mark();
+    render_batches(g_rendered_batch, &g_rendered, &frame_end);
+    g_rendered = frame_end;
+    g_rendered_batch = g_batches.n_batches > 0 ? g_batches.n_batches - 1 : 0;
+}
+
+static void present()
+{
+    if (g_backend == RENDER_BACKEND_SOFTWARE)
+    {
+        SDL_BlitSurface(g_sw_surface, NULL, SDL_GetWindowSurface(g_window), NULL);
+        SDL_UpdateWindowSurface(g_window);
+        return;
+    }
+
+    SDL_GL_SwapWindow(g_window); // Swap front- and backbuffer
+    // The new back buffer is undefined, a frame without clear_screen is drawn in full again
+    memset(&g_rendered, 0, sizeof(g_rendered));
+    g_rendered_batch = 0;
 }
 
 void load_font(const char *bitmap_file)
 {
-    SDL_Surface *surface = IMG_Load(bitmap_file);
-    if (surface == NULL)
+    // Pixels come pre-decoded from the mapped asset cache, no image decoding on the hot path
+    font_asset font;
+    font_asset_open(&font, bitmap_file);
+
+    if (g_backend == RENDER_BACKEND_SOFTWARE)
     {
-        printf("Failed to load font bitmap '%s': %s\n", bitmap_file, SDL_GetError());
-        abort();
+        sw_set_font(font.pixels, font.width, font.height);
+        memcpy(g_render_text.glyphs, font.glyphs, sizeof(g_render_text.glyphs));
+        font_asset_close(&font);
+        return;
     }
 
     GL_CALL(glBindVertexArray(g_render_text.vao));
@@ -91,13 +752,32 @@ void load_font(const char *bitmap_file)
     GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
     GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
     GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
-    GL_CALL(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, surface->w, surface->h, 0, GL_RGBA, GL_UNSIGNED_BYTE, surface->pixels));
+    GL_CALL(glPixelStorei(GL_UNPACK_ALIGNMENT, 4));
+    GL_CALL(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, font.width, font.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, font.pixels));
+    gl_label(GL_TEXTURE, g_render_text.font_texture, bitmap_file);
 
-    SDL_FreeSurface(surface);
+    memcpy(g_render_text.glyphs, font.glyphs, sizeof(g_render_text.glyphs));
+
+    font_asset_close(&font);
 }
 
 void make_window(int2 top_left, int2 size, const char* title)
 {
+    make_window_with_backend(top_left, size, title, RENDER_BACKEND_GL);
+}
+
+void make_window_with_backend(int2 top_left, int2 size, const char* title, render_backend backend)
+{
+    g_backend = backend;
+    g_window_size = size;
+
+    // RENDER2D_CAPTURE=<file> records all draw calls for offline replay
+    const char *capture_path = SDL_getenv("RENDER2D_CAPTURE");
+    if (capture_path != NULL)
+    {
+        start_capture(capture_path);
+    }
+
     SDL_Init(SDL_INIT_VIDEO);
 
     int imgFlags = IMG_INIT_JPG | IMG_INIT_PNG;
@@ -107,12 +787,41 @@ void make_window(int2 top_left, int2 size, const char* title)
         abort();
     }
 
+    // =====================================================
+    // =============== DEFAULT SETTINGS
+    // =====================================================
+    g_settings.max_fps = 60;
+
+    // RENDER2D_HIDDEN=1 keeps the window off screen, for tests rendering through read_framebuffer
+    const char *hidden_env = SDL_getenv("RENDER2D_HIDDEN");
+    Uint32 window_flags = hidden_env != NULL && strcmp(hidden_env, "1") == 0 ? SDL_WINDOW_HIDDEN : 0;
+
+    if (g_backend == RENDER_BACKEND_SOFTWARE)
+    {
+        g_window = SDL_CreateWindow(title, top_left.x, top_left.y, size.x, size.y, window_flags);
+        g_render_particles.gpu = false;
+        sw_init(size.x, size.y);
+        g_drawable_size = size; // no high-DPI scaling
+        update_sw_surface();
+        apply_view(g_window_size, g_drawable_size, g_coords);
+        return;
+    }
+
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, GL_VERSION_MAJOR);
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, GL_VERSION_MINOR);
     SDL_GL_SetAttribute(SDL_GL_STENCIL_SIZE, 8);
+
+    // Debug contexts may only report messages if requested at creation
+    read_check_level_from_env();
+    // Debug output works on regular contexts too, a debug context reports more but slows some drivers down
+    const char *debug_context_env = SDL_getenv("RENDER2D_GL_DEBUG_CONTEXT");
+    if (debug_context_env != NULL && strcmp(debug_context_env, "1") == 0)
+    {
+        SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, SDL_GL_CONTEXT_DEBUG_FLAG);
+    }
     SDL_GL_SetSwapInterval(0); // Toggle VSync (0 for off, 1 for on)
-    g_window = SDL_CreateWindow(title, top_left.x, top_left.y, size.x, size.y, SDL_WINDOW_OPENGL);
+    g_window = SDL_CreateWindow(title, top_left.x, top_left.y, size.x, size.y, window_flags | SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE | SDL_WINDOW_ALLOW_HIGHDPI);
 
     g_glcontext = SDL_GL_CreateContext(g_window);
 
@@ -124,15 +833,11 @@ void make_window(int2 top_left, int2 size, const char* title)
         printf("glewInit() failed! Error: %s\n", glewGetErrorString(glew_err));
         abort();
     }
+    gl_init_checks();
 
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-    // =====================================================
-    // =============== DEFAULT SETTINGS
-    // =====================================================
-    g_settings.max_fps = 60;
-
     // =====================================================
     // =============== SETUP TRIANGLE RENDER
     // =====================================================
@@ -166,6 +871,12 @@ void make_window(int2 top_left, int2 size, const char* title)
     GL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_render_triangles.index_buffer));
     // TODO: use glBufferStorage for persistent mapping
     GL_CALL(glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * PREALLOC_INDICES, NULL, GL_STREAM_DRAW));
+    g_render_triangles.vertex_capacity = PREALLOC_VERTICES;
+    g_render_triangles.index_capacity = PREALLOC_INDICES;
+
+    gl_label(GL_VERTEX_ARRAY, g_render_triangles.vao, "triangles vao");
+    gl_label(GL_BUFFER, g_render_triangles.vertex_buffer, "triangles vertices");
+    gl_label(GL_BUFFER, g_render_triangles.index_buffer, "triangles indices");
 
     // =====================================================
     // =============== SHADER
@@ -183,12 +894,13 @@ void make_window(int2 top_left, int2 size, const char* title)
         "// output\n"
         "flat out vec3 colorFragment; // output RGB color for fragment shader\n"
         "//out vec2 texcoordFragment; // 2d texture coord (rasterized)\n"
+        "uniform vec4 projection; // scale xy, offset zw, see apply_view\n"
         "void main()\n"
         "{\n"
         "    colorFragment = colorVertex;\n"
         "    //texcoordFragment = texcoordVertex;\n"
         "    // Map 2d position of triangle vertice onto 3d space\n"
-        "    vec2 positionOut = position;\n"
+        "    vec2 positionOut = position * projection.xy + projection.zw;\n"
         "    // if (positionOut.y > 0)\n"
         "    //     positionOut.y *= -1;\n"
         "    gl_Position = vec4(positionOut, 0.0, 1.0);\n"
@@ -218,6 +930,7 @@ void make_window(int2 top_left, int2 size, const char* title)
 
     // Create shader program
     g_render_triangles.shader = gl_compile_shader(vertexSource, fragmentSource, "outColor");
+    gl_label(GL_PROGRAM, g_render_triangles.shader, "triangles shader");
 
     // 6. Use program
     GL_CALL(glUseProgram(g_render_triangles.shader));
@@ -275,6 +988,12 @@ void make_window(int2 top_left, int2 size, const char* title)
     GL_CALL(glGenBuffers(1, &g_render_text.index_buffer));
     GL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_render_text.index_buffer));
     GL_CALL(glBufferData(GL_ELEMENT_ARRAY_BUFFER, PREALLOC_INDICES*sizeof(GLuint), NULL, GL_DYNAMIC_DRAW));
+    g_render_text.vertex_capacity = PREALLOC_VERTICES;
+    g_render_text.index_capacity = PREALLOC_INDICES;
+
+    gl_label(GL_VERTEX_ARRAY, g_render_text.vao, "text vao");
+    gl_label(GL_BUFFER, g_render_text.vertex_buffer, "text vertices");
+    gl_label(GL_BUFFER, g_render_text.index_buffer, "text indices");
 
     const char *textVertexSource =
         "#version 330 core\n"
@@ -285,12 +1004,13 @@ void make_window(int2 top_left, int2 size, const char* title)
         "// output\n"
         "out vec2 texcoordFragment; // 2d texture coord (rasterized)\n"
         "out vec3 colorFragment; // color of vertex (rasterized)\n"
+        "uniform vec4 projection;\n"
         "void main()\n"
         "{\n"
         "    texcoordFragment = texcoordVertex;\n"
         "    colorFragment = colorVertex;\n"
         "    // Map 2d position of triangle vertice onto 3d space\n"
-        "    gl_Position = vec4(position, 0.0, 1.0);\n"
+        "    gl_Position = vec4(position * projection.xy + projection.zw, 0.0, 1.0);\n"
         "}\n";
 
     const char *textFragmentSource =
@@ -306,6 +1026,7 @@ void make_window(int2 top_left, int2 size, const char* title)
         "}\n";
 
     g_render_text.shader = gl_compile_shader(textVertexSource, textFragmentSource, "outColor");
+    gl_label(GL_PROGRAM, g_render_text.shader, "text shader");
 
     GL_CALL(glUseProgram(g_render_text.shader));
 
@@ -325,54 +1046,590 @@ void make_window(int2 top_left, int2 size, const char* title)
     GLint color_attrib_text = 2; // GL_CALL(glGetAttribLocation(g_render_text.shader, "colorVertex"));
     GL_CALL(glEnableVertexAttribArray(color_attrib_text));
     GL_CALL(glVertexAttribPointer(color_attrib_text, 3, GL_FLOAT, GL_FALSE, sizeof(text_vertex), (void*)(4*sizeof(float))));
-}
 
-void teardown_window()
-{
-    glDeleteTextures(1, &g_render_text.font_texture);
-    glDeleteBuffers(1, &g_render_text.index_buffer);
-    glDeleteBuffers(1, &g_render_text.vertex_buffer);
-    glDeleteVertexArrays(1, &g_render_text.vao);
-    glDeleteProgram(g_render_text.shader);
-    glDeleteBuffers(1, &g_render_triangles.index_buffer);
-    glDeleteBuffers(1, &g_render_triangles.vertex_buffer);
-    glDeleteVertexArrays(1, &g_render_triangles.vao);
-    glDeleteProgram(g_render_triangles.shader);
-    SDL_GL_DeleteContext(g_glcontext);
-    SDL_DestroyWindow(g_window);
-    SDL_Quit();
-}
+    // =====================================================
+    // SETUP TILEMAP RENDERING
+    // =====================================================
 
-void main_loop(tick_func tick) {
-    bool doRun = true;
-    Uint64 prev_tick_end = 0;
-    while (doRun)
-    {
-        // React to new events
-        SDL_Event windowEvent;
-        while (SDL_PollEvent(&windowEvent))
-        {
-            if (windowEvent.type == SDL_QUIT) doRun = false;
-        }
+    GL_CALL(glGenVertexArrays(1, &g_render_tilemaps.vao));
+    gl_label(GL_VERTEX_ARRAY, g_render_tilemaps.vao, "tilemap vao");
 
-        Uint64 tick_start = SDL_GetPerformanceCounter();
-        if (prev_tick_end != 0) {
-            float delta = (tick_start - prev_tick_end) / (float)SDL_GetPerformanceFrequency();
-            tick(delta);
-        }
-        prev_tick_end = SDL_GetPerformanceCounter();
-        // printf("indices: %zd", g_n_indices);
-        // printf("; vertices: %zd\n", g_n_vertices);
+    const char *tilemapVertexSource =
+        "#version 330 core\n"
+        "uniform vec2 top_left;\n"
+        "uniform vec2 size;\n"
+        "uniform ivec2 cells;\n"
+        "uniform vec4 projection;\n"
+        "out vec2 cellCoord; // position in cells, (0, 0) at the top left\n"
+        "void main()\n"
+        "{\n"
+        "    // Triangle strip: (0, 0), (1, 0), (0, 1), (1, 1)\n"
+        "    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);\n"
+        "    cellCoord = corner * vec2(cells);\n"
+        "    vec2 position = vec2(top_left.x + corner.x * size.x, top_left.y - corner.y * size.y);\n"
+        "    gl_Position = vec4(position * projection.xy + projection.zw, 0.0, 1.0);\n"
+        "}\n";
 
-        do_render();
-        SDL_GL_SwapWindow(g_window); // Swap front- and backbuffer
+    const char *tilemapFragmentSource =
+        "#version 330 core\n"
+        "uniform usampler2D cell_states;\n"
+        "uniform sampler2D palette;\n"
+        "in vec2 cellCoord;\n"
+        "out vec4 outColor;\n"
+        "void main()\n"
+        "{\n"
+        "    ivec2 cell = min(ivec2(cellCoord), textureSize(cell_states, 0) - 1);\n"
+        "    uint state = texelFetch(cell_states, cell, 0).r;\n"
+        "    outColor = texelFetch(palette, ivec2(int(state), 0), 0);\n"
+        "}\n";
 
-        // TODO use SDL_Ticks64 instead?
-        Uint64 tick_end = SDL_GetPerformanceCounter();
+    g_render_tilemaps.shader = gl_compile_shader(tilemapVertexSource, tilemapFragmentSource, "outColor");
+    gl_label(GL_PROGRAM, g_render_tilemaps.shader, "tilemap shader");
 
-        if (g_settings.max_fps > 0) {
-            float ms_per_frame = 1000.f / g_settings.max_fps;
-            float ms_per_frame_actual = 1000.f * (tick_end - tick_start) / (float)SDL_GetPerformanceFrequency();
+    GL_CALL(glUseProgram(g_render_tilemaps.shader));
+    g_render_tilemaps.loc_top_left = GL_CALL(glGetUniformLocation(g_render_tilemaps.shader, "top_left"));
+    g_render_tilemaps.loc_size = GL_CALL(glGetUniformLocation(g_render_tilemaps.shader, "size"));
+    g_render_tilemaps.loc_cells = GL_CALL(glGetUniformLocation(g_render_tilemaps.shader, "cells"));
+    GL_CALL(glUniform1i(glGetUniformLocation(g_render_tilemaps.shader, "cell_states"), 1));
+    GL_CALL(glUniform1i(glGetUniformLocation(g_render_tilemaps.shader, "palette"), 2));
+
+    // =====================================================
+    // SETUP SHAPE RENDERING
+    // =====================================================
+
+    GL_CALL(glGenVertexArrays(1, &g_render_shapes.vao));
+    GL_CALL(glBindVertexArray(g_render_shapes.vao));
+    gl_label(GL_VERTEX_ARRAY, g_render_shapes.vao, "shape vao");
+    GL_CALL(glGenBuffers(1, &g_render_shapes.instance_buffer));
+    GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, g_render_shapes.instance_buffer));
+    gl_label(GL_BUFFER, g_render_shapes.instance_buffer, "shape instances");
+
+    // One instance per shape, the quad corners come from gl_VertexID
+    GLsizei shape_stride = sizeof(shape_instance);
+    GL_CALL(glEnableVertexAttribArray(0));
+    GL_CALL(glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, shape_stride, (void*)offsetof(shape_instance, p0)));
+    GL_CALL(glEnableVertexAttribArray(1));
+    GL_CALL(glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, shape_stride, (void*)offsetof(shape_instance, p1)));
+    GL_CALL(glEnableVertexAttribArray(2));
+    GL_CALL(glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, shape_stride, (void*)offsetof(shape_instance, p2)));
+    GL_CALL(glEnableVertexAttribArray(3));
+    GL_CALL(glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, shape_stride, (void*)offsetof(shape_instance, params)));
+    GL_CALL(glEnableVertexAttribArray(4));
+    GL_CALL(glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, shape_stride, (void*)offsetof(shape_instance, col)));
+    GL_CALL(glEnableVertexAttribArray(5));
+    GL_CALL(glVertexAttribIPointer(5, 1, GL_UNSIGNED_INT, shape_stride, (void*)offsetof(shape_instance, kind)));
+    for (GLuint i = 0; i <= 5; i++)
+    {
+        GL_CALL(glVertexAttribDivisor(i, 1));
+    }
+
+    GL_CALL(glGenVertexArrays(1, &g_render_shapes.polyline_vao));
+    GL_CALL(glBindVertexArray(g_render_shapes.polyline_vao));
+    gl_label(GL_VERTEX_ARRAY, g_render_shapes.polyline_vao, "polyline vao");
+    GL_CALL(glGenBuffers(1, &g_render_shapes.point_buffer));
+    GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, g_render_shapes.point_buffer));
+    gl_label(GL_BUFFER, g_render_shapes.point_buffer, "polyline points");
+
+    // Both attributes step through the same points, b is one point ahead
+    GL_CALL(glEnableVertexAttribArray(0));
+    GL_CALL(glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(float2), (void*)0));
+    GL_CALL(glVertexAttribDivisor(0, 1));
+    GL_CALL(glEnableVertexAttribArray(1));
+    GL_CALL(glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(float2), (void*)sizeof(float2)));
+    GL_CALL(glVertexAttribDivisor(1, 1));
+
+#define SHAPE_SDF_GLSL \
+        "float sd_segment(vec2 p, vec2 a, vec2 b)\n" \
+        "{\n" \
+        "    vec2 pa = p - a, ba = b - a;\n" \
+        "    float h = clamp(dot(pa, ba) / max(dot(ba, ba), 1e-8), 0.0, 1.0);\n" \
+        "    return length(pa - ba * h);\n" \
+        "}\n" \
+        "// Quad around a segment, extended by half the thickness plus one pixel for the AA ramp\n" \
+        "vec2 segment_corner(vec2 corner, vec2 a, vec2 b, float thickness)\n" \
+        "{\n" \
+        "    float e = thickness * 0.5 + 1.0;\n" \
+        "    vec2 d = b - a;\n" \
+        "    float len = length(d);\n" \
+        "    vec2 dir = len > 0.0 ? d / len : vec2(1.0, 0.0);\n" \
+        "    vec2 n = vec2(-dir.y, dir.x);\n" \
+        "    return (a + b) * 0.5 + dir * corner.x * (len * 0.5 + e) + n * corner.y * e;\n" \
+        "}\n"
+
+    // Distances are in pixels, one pixel wide coverage ramp centered on the edge
+    const char *shapeVertexSource =
+        "#version 330 core\n"
+        "layout(location = 0) in vec2 p0;\n"
+        "layout(location = 1) in vec2 p1;\n"
+        "layout(location = 2) in vec2 p2;\n"
+        "layout(location = 3) in vec2 params;\n"
+        "layout(location = 4) in vec3 col;\n"
+        "layout(location = 5) in uint kind;\n"
+        "uniform vec2 half_size; // NDC to drawable pixels\n"
+        "uniform vec4 projection;\n"
+        "flat out uint shapeKind;\n"
+        "flat out vec2 shapeP0;\n"
+        "flat out vec2 shapeP1;\n"
+        "flat out vec2 shapeP2;\n"
+        "flat out vec2 shapeParams;\n"
+        "flat out vec3 shapeCol;\n"
+        "out vec2 pixel;\n"
+        SHAPE_SDF_GLSL
+        "void main()\n"
+        "{\n"
+        "    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1) * 2.0 - 1.0;\n"
+        "    vec2 a = (p0 * projection.xy + projection.zw) * half_size;\n"
+        "    vec2 b = (p1 * projection.xy + projection.zw) * half_size;\n"
+        "    vec2 c = (p2 * projection.xy + projection.zw) * half_size;\n"
+        "    if (kind == 0u) pixel = segment_corner(corner, a, b, params.x);\n"
+        "    else if (kind == 1u) pixel = a + corner * (params.x + 1.0);\n"
+        "    else pixel = mix(min(min(a, b), c) - 1.0, max(max(a, b), c) + 1.0, corner * 0.5 + 0.5);\n"
+        "    shapeKind = kind;\n"
+        "    shapeP0 = a;\n"
+        "    shapeP1 = b;\n"
+        "    shapeP2 = c;\n"
+        "    shapeParams = params;\n"
+        "    shapeCol = col;\n"
+        "    gl_Position = vec4(pixel / half_size, 0.0, 1.0);\n"
+        "}\n";
+
+    const char *shapeFragmentSource =
+        "#version 330 core\n"
+        "flat in uint shapeKind;\n"
+        "flat in vec2 shapeP0;\n"
+        "flat in vec2 shapeP1;\n"
+        "flat in vec2 shapeP2;\n"
+        "flat in vec2 shapeParams;\n"
+        "flat in vec3 shapeCol;\n"
+        "in vec2 pixel;\n"
+        "out vec4 outColor;\n"
+        SHAPE_SDF_GLSL
+        "// Works for both windings\n"
+        "float sd_triangle(vec2 p, vec2 p0, vec2 p1, vec2 p2)\n"
+        "{\n"
+        "    vec2 e0 = p1 - p0, e1 = p2 - p1, e2 = p0 - p2;\n"
+        "    vec2 v0 = p - p0, v1 = p - p1, v2 = p - p2;\n"
+        "    vec2 pq0 = v0 - e0 * clamp(dot(v0, e0) / max(dot(e0, e0), 1e-8), 0.0, 1.0);\n"
+        "    vec2 pq1 = v1 - e1 * clamp(dot(v1, e1) / max(dot(e1, e1), 1e-8), 0.0, 1.0);\n"
+        "    vec2 pq2 = v2 - e2 * clamp(dot(v2, e2) / max(dot(e2, e2), 1e-8), 0.0, 1.0);\n"
+        "    float s = sign(e0.x * e2.y - e0.y * e2.x);\n"
+        "    vec2 d = min(min(vec2(dot(pq0, pq0), s * (v0.x * e0.y - v0.y * e0.x)),\n"
+        "                     vec2(dot(pq1, pq1), s * (v1.x * e1.y - v1.y * e1.x))),\n"
+        "                     vec2(dot(pq2, pq2), s * (v2.x * e2.y - v2.y * e2.x)));\n"
+        "    return -sqrt(d.x) * sign(d.y);\n"
+        "}\n"
+        "void main()\n"
+        "{\n"
+        "    float d;\n"
+        "    if (shapeKind == 0u) d = sd_segment(pixel, shapeP0, shapeP1) - shapeParams.x * 0.5;\n"
+        "    else if (shapeKind == 1u) {\n"
+        "        float mid = (shapeParams.x + shapeParams.y) * 0.5;\n"
+        "        float half_width = (shapeParams.x - shapeParams.y) * 0.5;\n"
+        "        d = abs(length(pixel - shapeP0) - mid) - half_width;\n"
+        "    }\n"
+        "    else d = sd_triangle(pixel, shapeP0, shapeP1, shapeP2);\n"
+        "    float coverage = clamp(0.5 - d, 0.0, 1.0);\n"
+        "    if (coverage <= 0.0) discard;\n"
+        "    outColor = vec4(shapeCol, coverage);\n"
+        "}\n";
+
+    const char *polylineVertexSource =
+        "#version 330 core\n"
+        "layout(location = 0) in vec2 p0;\n"
+        "layout(location = 1) in vec2 p1;\n"
+        "uniform vec2 half_size;\n"
+        "uniform vec4 projection;\n"
+        "uniform float thickness;\n"
+        "flat out vec2 segmentA;\n"
+        "flat out vec2 segmentB;\n"
+        "out vec2 pixel;\n"
+        SHAPE_SDF_GLSL
+        "void main()\n"
+        "{\n"
+        "    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1) * 2.0 - 1.0;\n"
+        "    segmentA = (p0 * projection.xy + projection.zw) * half_size;\n"
+        "    segmentB = (p1 * projection.xy + projection.zw) * half_size;\n"
+        "    pixel = segment_corner(corner, segmentA, segmentB, thickness);\n"
+        "    gl_Position = vec4(pixel / half_size, 0.0, 1.0);\n"
+        "}\n";
+
+    const char *polylineFragmentSource =
+        "#version 330 core\n"
+        "uniform float thickness;\n"
+        "uniform vec3 col;\n"
+        "flat in vec2 segmentA;\n"
+        "flat in vec2 segmentB;\n"
+        "in vec2 pixel;\n"
+        "out vec4 outColor;\n"
+        SHAPE_SDF_GLSL
+        "void main()\n"
+        "{\n"
+        "    float d = sd_segment(pixel, segmentA, segmentB) - thickness * 0.5;\n"
+        "    float coverage = clamp(0.5 - d, 0.0, 1.0);\n"
+        "    if (coverage <= 0.0) discard;\n"
+        "    outColor = vec4(col, coverage);\n"
+        "}\n";
+
+#undef SHAPE_SDF_GLSL
+
+    g_render_shapes.shader = gl_compile_shader(shapeVertexSource, shapeFragmentSource, "outColor");
+    gl_label(GL_PROGRAM, g_render_shapes.shader, "shape shader");
+    g_render_shapes.loc_half_size = GL_CALL(glGetUniformLocation(g_render_shapes.shader, "half_size"));
+
+    g_render_shapes.polyline_shader = gl_compile_shader(polylineVertexSource, polylineFragmentSource, "outColor");
+    gl_label(GL_PROGRAM, g_render_shapes.polyline_shader, "polyline shader");
+    g_render_shapes.loc_polyline_half_size = GL_CALL(glGetUniformLocation(g_render_shapes.polyline_shader, "half_size"));
+    g_render_shapes.loc_polyline_thickness = GL_CALL(glGetUniformLocation(g_render_shapes.polyline_shader, "thickness"));
+    g_render_shapes.loc_polyline_col = GL_CALL(glGetUniformLocation(g_render_shapes.polyline_shader, "col"));
+
+    // =====================================================
+    // SETUP RENDER CACHES
+    // =====================================================
+
+    GL_CALL(glGenVertexArrays(1, &g_render_caches.vao));
+    gl_label(GL_VERTEX_ARRAY, g_render_caches.vao, "render cache vao");
+
+    const char *cacheVertexSource =
+        "#version 330 core\n"
+        "uniform vec4 rect; // min x, min y, max x, max y in NDC\n"
+        "out vec2 uv;\n"
+        "void main()\n"
+        "{\n"
+        "    uv = vec2(gl_VertexID & 1, gl_VertexID >> 1);\n"
+        "    gl_Position = vec4(mix(rect.xy, rect.zw, uv), 0.0, 1.0);\n"
+        "}\n";
+
+    // Cache textures hold premultiplied colors, composited with GL_ONE, GL_ONE_MINUS_SRC_ALPHA
+    const char *cacheFragmentSource =
+        "#version 330 core\n"
+        "uniform sampler2D content;\n"
+        "in vec2 uv;\n"
+        "out vec4 outColor;\n"
+        "void main()\n"
+        "{\n"
+        "    outColor = texture(content, uv);\n"
+        "}\n";
+
+    g_render_caches.shader = gl_compile_shader(cacheVertexSource, cacheFragmentSource, "outColor");
+    gl_label(GL_PROGRAM, g_render_caches.shader, "render cache shader");
+    GL_CALL(glUseProgram(g_render_caches.shader));
+    g_render_caches.loc_rect = GL_CALL(glGetUniformLocation(g_render_caches.shader, "rect"));
+    GL_CALL(glUniform1i(glGetUniformLocation(g_render_caches.shader, "content"), 3));
+
+    // =====================================================
+    // SETUP PARTICLE RENDERING
+    // =====================================================
+
+    // Some drivers have compute shaders but no storage buffers in the vertex stage
+    GLint vertex_storage_blocks = 0;
+    if (GLEW_VERSION_4_3)
+    {
+        GL_CALL(glGetIntegerv(GL_MAX_VERTEX_SHADER_STORAGE_BLOCKS, &vertex_storage_blocks));
+    }
+    const char *particles_env = SDL_getenv("RENDER2D_PARTICLES");
+    g_render_particles.gpu = vertex_storage_blocks > 0 && (particles_env == NULL || strcmp(particles_env, "cpu") != 0);
+
+    // Shared by both paths, the GPU vertex shader may be a newer version
+    const char *particleFragmentSource =
+        "#version 330 core\n"
+        "in vec2 quadPos;\n"
+        "in vec4 color;\n"
+        "out vec4 outColor;\n"
+        "void main()\n"
+        "{\n"
+        "    float d = length(quadPos);\n"
+        "    float coverage = 1.0 - smoothstep(1.0 - fwidth(d), 1.0, d);\n"
+        "    if (coverage <= 0.0) discard;\n"
+        "    outColor = vec4(color.rgb, color.a * coverage);\n"
+        "}\n";
+
+    GL_CALL(glGenVertexArrays(1, &g_render_particles.vao));
+    gl_label(GL_VERTEX_ARRAY, g_render_particles.vao, "particle vao");
+
+    if (!g_render_particles.gpu)
+    {
+        printf("Particles: simulating on the CPU\n");
+
+        // Live particles are streamed as instances, same quads as the storage buffer path
+        const char *particleInstanceVertexSource =
+            "#version 330 core\n"
+            "layout(location = 0) in vec2 center;\n"
+            "layout(location = 1) in float size;\n"
+            "layout(location = 2) in vec4 instanceColor;\n"
+            "uniform vec4 projection;\n"
+            "out vec2 quadPos; // -1..1 across the particle\n"
+            "out vec4 color;\n"
+            "void main()\n"
+            "{\n"
+            "    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);\n"
+            "    quadPos = corner * 2.0 - 1.0;\n"
+            "    color = instanceColor;\n"
+            "    gl_Position = vec4((center + quadPos * 0.5 * size) * projection.xy + projection.zw, 0.0, 1.0);\n"
+            "}\n";
+
+        g_render_particles.shader = gl_compile_shader(particleInstanceVertexSource, particleFragmentSource, "outColor");
+        gl_label(GL_PROGRAM, g_render_particles.shader, "particle shader");
+
+        GL_CALL(glBindVertexArray(g_render_particles.vao));
+        GL_CALL(glGenBuffers(1, &g_render_particles.instance_buffer));
+        GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, g_render_particles.instance_buffer));
+        gl_label(GL_BUFFER, g_render_particles.instance_buffer, "particle instances");
+
+        GLsizei stride = sizeof(particle_instance);
+        GL_CALL(glEnableVertexAttribArray(0));
+        GL_CALL(glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(particle_instance, pos)));
+        GL_CALL(glEnableVertexAttribArray(1));
+        GL_CALL(glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(particle_instance, size)));
+        // col and alpha are adjacent, read as one vec4
+        GL_CALL(glEnableVertexAttribArray(2));
+        GL_CALL(glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(particle_instance, col)));
+        for (GLuint i = 0; i <= 2; i++)
+        {
+            GL_CALL(glVertexAttribDivisor(i, 1));
+        }
+        // All programs exist now, the GPU path does the same at the end
+        update_window_size();
+        return;
+    }
+
+#define PARTICLE_GLSL \
+        "struct particle {\n" \
+        "    vec2 pos;\n" \
+        "    vec2 vel;\n" \
+        "    vec3 color_start;\n" \
+        "    float size;\n" \
+        "    vec3 color_end;\n" \
+        "    float age;\n" \
+        "    float lifetime;\n" \
+        "};\n"
+
+    // Same hash and draw order as spawn_particle, the CPU path spawns identical particles
+    const char *particleEmitSource =
+        "#version 430 core\n"
+        "layout(local_size_x = 64) in;\n"
+        PARTICLE_GLSL
+        "layout(std430, binding = 0) buffer Particles { particle particles[]; };\n"
+        "uniform uint first;\n"
+        "uniform uint count;\n"
+        "uniform uint seed;\n"
+        "uniform vec2 position;\n"
+        "uniform vec2 position_spread;\n"
+        "uniform vec2 velocity;\n"
+        "uniform vec2 velocity_spread;\n"
+        "uniform vec2 lifetime; // base, spread\n"
+        "uniform float size;\n"
+        "uniform vec3 color_start;\n"
+        "uniform vec3 color_end;\n"
+        "uint hash(uint x)\n"
+        "{\n"
+        "    x ^= x >> 16; x *= 0x7feb352du;\n"
+        "    x ^= x >> 15; x *= 0x846ca68bu;\n"
+        "    x ^= x >> 16;\n"
+        "    return x;\n"
+        "}\n"
+        "float rand(inout uint state) // [-1, 1)\n"
+        "{\n"
+        "    state = hash(state);\n"
+        "    return float(state >> 8) * (2.0 / 16777216.0) - 1.0;\n"
+        "}\n"
+        "void main()\n"
+        "{\n"
+        "    uint i = gl_GlobalInvocationID.x;\n"
+        "    if (i >= count) return;\n"
+        "    uint state = hash(seed + i * 0x9e3779b9u);\n"
+        "    float px = rand(state);\n"
+        "    float py = rand(state);\n"
+        "    float vx = rand(state);\n"
+        "    float vy = rand(state);\n"
+        "    float life = rand(state);\n"
+        "    particle p;\n"
+        "    p.pos = position + vec2(px, py) * position_spread;\n"
+        "    p.vel = velocity + vec2(vx, vy) * velocity_spread;\n"
+        "    p.color_start = color_start;\n"
+        "    p.size = size;\n"
+        "    p.color_end = color_end;\n"
+        "    p.age = 0.0;\n"
+        "    p.lifetime = max(lifetime.x + life * lifetime.y, 0.0);\n"
+        "    particles[(first + i) % uint(particles.length())] = p;\n"
+        "}\n";
+
+    const char *particleUpdateSource =
+        "#version 430 core\n"
+        "layout(local_size_x = 64) in;\n"
+        PARTICLE_GLSL
+        "layout(std430, binding = 0) buffer Particles { particle particles[]; };\n"
+        "uniform float dt;\n"
+        "uniform vec2 gravity;\n"
+        "uniform float drag;\n"
+        "void main()\n"
+        "{\n"
+        "    uint i = gl_GlobalInvocationID.x;\n"
+        "    if (i >= uint(particles.length()) || !(particles[i].age < particles[i].lifetime)) return;\n"
+        "    vec2 vel = (particles[i].vel + gravity * dt) * max(1.0 - drag * dt, 0.0);\n"
+        "    particles[i].vel = vel;\n"
+        "    particles[i].pos += vel * dt;\n"
+        "    particles[i].age += dt;\n"
+        "}\n";
+
+    const char *particleVertexSource =
+        "#version 430 core\n"
+        PARTICLE_GLSL
+        "layout(std430, binding = 0) readonly buffer Particles { particle particles[]; };\n"
+        "uniform vec4 projection;\n"
+        "out vec2 quadPos; // -1..1 across the particle\n"
+        "out vec4 color;\n"
+        "void main()\n"
+        "{\n"
+        "    particle p = particles[gl_InstanceID];\n"
+        "    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);\n"
+        "    quadPos = corner * 2.0 - 1.0;\n"
+        "    if (!(p.age < p.lifetime))\n"
+        "    {\n"
+        "        // Behind the far plane, clipped before rasterization\n"
+        "        color = vec4(0.0);\n"
+        "        gl_Position = vec4(0.0, 0.0, 2.0, 1.0);\n"
+        "        return;\n"
+        "    }\n"
+        "    float t = p.age / p.lifetime;\n"
+        "    color = vec4(mix(p.color_start, p.color_end, t), 1.0 - t);\n"
+        "    gl_Position = vec4((p.pos + quadPos * 0.5 * p.size) * projection.xy + projection.zw, 0.0, 1.0);\n"
+        "}\n";
+
+#undef PARTICLE_GLSL
+
+    g_render_particles.emit_shader = gl_compile_compute_shader(particleEmitSource);
+    g_render_particles.update_shader = gl_compile_compute_shader(particleUpdateSource);
+    g_render_particles.shader = gl_compile_shader(particleVertexSource, particleFragmentSource, "outColor");
+    gl_label(GL_PROGRAM, g_render_particles.emit_shader, "particle emit shader");
+    gl_label(GL_PROGRAM, g_render_particles.update_shader, "particle update shader");
+    gl_label(GL_PROGRAM, g_render_particles.shader, "particle shader");
+
+    glid emit = g_render_particles.emit_shader;
+    g_render_particles.loc_emit_first = GL_CALL(glGetUniformLocation(emit, "first"));
+    g_render_particles.loc_emit_count = GL_CALL(glGetUniformLocation(emit, "count"));
+    g_render_particles.loc_emit_seed = GL_CALL(glGetUniformLocation(emit, "seed"));
+    g_render_particles.loc_emit_position = GL_CALL(glGetUniformLocation(emit, "position"));
+    g_render_particles.loc_emit_position_spread = GL_CALL(glGetUniformLocation(emit, "position_spread"));
+    g_render_particles.loc_emit_velocity = GL_CALL(glGetUniformLocation(emit, "velocity"));
+    g_render_particles.loc_emit_velocity_spread = GL_CALL(glGetUniformLocation(emit, "velocity_spread"));
+    g_render_particles.loc_emit_lifetime = GL_CALL(glGetUniformLocation(emit, "lifetime"));
+    g_render_particles.loc_emit_size = GL_CALL(glGetUniformLocation(emit, "size"));
+    g_render_particles.loc_emit_color_start = GL_CALL(glGetUniformLocation(emit, "color_start"));
+    g_render_particles.loc_emit_color_end = GL_CALL(glGetUniformLocation(emit, "color_end"));
+
+    glid update = g_render_particles.update_shader;
+    g_render_particles.loc_update_dt = GL_CALL(glGetUniformLocation(update, "dt"));
+    g_render_particles.loc_update_gravity = GL_CALL(glGetUniformLocation(update, "gravity"));
+    g_render_particles.loc_update_drag = GL_CALL(glGetUniformLocation(update, "drag"));
+
+    update_window_size();
+}
+
+void teardown_window()
+{
+    stop_capture();
+
+    if (g_backend == RENDER_BACKEND_SOFTWARE)
+    {
+        SDL_FreeSurface(g_sw_surface);
+        g_sw_surface = NULL;
+        sw_shutdown();
+        SDL_DestroyWindow(g_window);
+        SDL_Quit();
+        return;
+    }
+
+    glDeleteVertexArrays(1, &g_render_particles.vao);
+    glDeleteProgram(g_render_particles.shader);
+    if (g_render_particles.gpu)
+    {
+        glDeleteProgram(g_render_particles.update_shader);
+        glDeleteProgram(g_render_particles.emit_shader);
+    }
+    else
+    {
+        glDeleteBuffers(1, &g_render_particles.instance_buffer);
+        free(g_render_particles.instances);
+    }
+    while (g_render_caches.n_caches > 0)
+    {
+        render_cache_destroy(g_render_caches.caches[0]);
+    }
+    free(g_render_caches.caches);
+    glDeleteVertexArrays(1, &g_render_caches.vao);
+    glDeleteProgram(g_render_caches.shader);
+    glDeleteBuffers(1, &g_render_shapes.point_buffer);
+    glDeleteVertexArrays(1, &g_render_shapes.polyline_vao);
+    glDeleteProgram(g_render_shapes.polyline_shader);
+    glDeleteBuffers(1, &g_render_shapes.instance_buffer);
+    glDeleteVertexArrays(1, &g_render_shapes.vao);
+    glDeleteProgram(g_render_shapes.shader);
+    free(g_render_shapes.instances);
+    free(g_render_shapes.points);
+    free(g_render_shapes.polylines);
+    glDeleteVertexArrays(1, &g_render_tilemaps.vao);
+    glDeleteProgram(g_render_tilemaps.shader);
+    glDeleteTextures(1, &g_render_text.font_texture);
+    glDeleteBuffers(1, &g_render_text.index_buffer);
+    glDeleteBuffers(1, &g_render_text.vertex_buffer);
+    glDeleteVertexArrays(1, &g_render_text.vao);
+    glDeleteProgram(g_render_text.shader);
+    glDeleteBuffers(1, &g_render_triangles.index_buffer);
+    glDeleteBuffers(1, &g_render_triangles.vertex_buffer);
+    glDeleteVertexArrays(1, &g_render_triangles.vao);
+    glDeleteProgram(g_render_triangles.shader);
+    SDL_GL_DeleteContext(g_glcontext);
+    SDL_DestroyWindow(g_window);
+    SDL_Quit();
+
+    // Another make_window in the same process starts from scratch, e.g. to compare backends
+    memset(&g_render_triangles, 0, sizeof(g_render_triangles));
+    memset(&g_render_text, 0, sizeof(g_render_text));
+    memset(&g_render_tilemaps, 0, sizeof(g_render_tilemaps));
+    memset(&g_render_particles, 0, sizeof(g_render_particles));
+    memset(&g_render_shapes, 0, sizeof(g_render_shapes));
+    memset(&g_render_caches, 0, sizeof(g_render_caches));
+    memset(&g_rendered, 0, sizeof(g_rendered));
+    g_glcontext = NULL;
+}
+
+void main_loop(tick_func tick) {
+    bool doRun = true;
+    Uint64 prev_tick_end = 0;
+    while (doRun)
+    {
+        // React to new events
+        SDL_Event windowEvent;
+        while (SDL_PollEvent(&windowEvent))
+        {
+            if (windowEvent.type == SDL_QUIT) doRun = false;
+            handle_window_event(&windowEvent);
+        }
+
+        Uint64 tick_start = SDL_GetPerformanceCounter();
+        if (prev_tick_end != 0) {
+            float delta = (tick_start - prev_tick_end) / (float)SDL_GetPerformanceFrequency();
+            tick(delta);
+            end_capture_frame(delta);
+        }
+        prev_tick_end = SDL_GetPerformanceCounter();
+        // printf("indices: %zd", g_n_indices);
+        // printf("; vertices: %zd\n", g_n_vertices);
+
+        do_render();
+        Uint64 render_end = SDL_GetPerformanceCounter();
+        present();
+
+        // TODO use SDL_Ticks64 instead?
+        Uint64 tick_end = SDL_GetPerformanceCounter();
+
+        update_timing(&g_timings.tick_ms, tick_start, prev_tick_end);
+        update_timing(&g_timings.render_ms, prev_tick_end, render_end);
+        update_timing(&g_timings.present_ms, render_end, tick_end);
+
+        if (g_settings.max_fps > 0) {
+            float ms_per_frame = 1000.f / g_settings.max_fps;
+            float ms_per_frame_actual = 1000.f * (tick_end - tick_start) / (float)SDL_GetPerformanceFrequency();
             if (ms_per_frame_actual < ms_per_frame) {
 
                 SDL_Delay((u32)(ms_per_frame - ms_per_frame_actual));
@@ -383,51 +1640,179 @@ void main_loop(tick_func tick) {
 
 void clear_screen(float3 col)
 {
+    if (g_record_packet != NULL)
+    {
+        // Recorded draws are replaced, same as clearing the GL buffers
+        draw_list_reset(g_record_packet->list);
+        g_record_packet->clear = true;
+        g_record_packet->clear_color = col;
+        g_record_packet->n_particle_draws = 0;
+        g_record_packet->n_particle_instances = 0;
+        return;
+    }
+
+    if (capture_file_is_open())
+    {
+        capture_clear(&g_capture, col);
+    }
+    clear_frame(col);
+}
+
+static void clear_frame(float3 col)
+{
+    g_render_tilemaps.n_draws = 0;
+    g_render_particles.n_draws = 0;
+    g_render_particles.n_instances = 0;
+    g_render_shapes.n_instances = 0;
+    g_render_shapes.n_points = 0;
+    g_render_shapes.n_polylines = 0;
+    g_render_caches.n_draws = 0;
     g_render_triangles.n_indices = 0;
     g_render_triangles.n_vertices = 0;
     g_render_text.n_indices = 0;
     g_render_text.n_vertices = 0;
+    g_batches.n_batches = 0;
+    memset(&g_rendered, 0, sizeof(g_rendered));
+    g_rendered_batch = 0;
+
+    if (g_backend == RENDER_BACKEND_SOFTWARE)
+    {
+        sw_clear(col);
+        return;
+    }
+
     GL_CALL(glClearColor(col.x, col.y, col.z, 1.0f));
     GL_CALL(glClear(GL_COLOR_BUFFER_BIT));
 }
 
+typedef struct {
+    GLintptr src;
+    GLintptr dst;
+    GLsizeiptr size;
+} buffer_move;
+
+// Reallocates a buffer under the same name, so VAO bindings stay valid, and copies the live ranges over
+static void resize_gl_buffer(glid buffer, GLsizeiptr old_size, GLsizeiptr new_size, GLenum usage, const buffer_move *moves, int n_moves)
+{
+    glid tmp;
+    GL_CALL(glCreateBuffers(1, &tmp));
+    GL_CALL(glNamedBufferData(tmp, old_size, NULL, GL_STREAM_COPY));
+    GL_CALL(glCopyNamedBufferSubData(buffer, tmp, 0, 0, old_size));
+    GL_CALL(glNamedBufferData(buffer, new_size, NULL, usage));
+    for (int i = 0; i < n_moves; i++)
+    {
+        if (moves[i].size > 0)
+        {
+            GL_CALL(glCopyNamedBufferSubData(tmp, buffer, moves[i].src, moves[i].dst, moves[i].size));
+        }
+    }
+    GL_CALL(glDeleteBuffers(1, &tmp));
+}
+
+static u32 grow_capacity(u32 capacity, u32 needed)
+{
+    while (capacity < needed) capacity *= 2;
+    return capacity;
+}
+
+// Makes room for n more vertices / indices in the triangle buffers, doubling them as needed
+static void reserve_triangles(u32 n_vertices, u32 n_indices)
+{
+    u32 needed = g_render_triangles.n_vertices + n_vertices;
+    if (needed > g_render_triangles.vertex_capacity)
+    {
+        u32 old_capacity = g_render_triangles.vertex_capacity;
+        u32 capacity = grow_capacity(old_capacity, needed);
+        u32 n = g_render_triangles.n_vertices;
+        buffer_move moves[2] = {
+            { 0, 0, n * sizeof(float2) },
+            { old_capacity * sizeof(float2), capacity * sizeof(float2), n * sizeof(float3) },
+        };
+        resize_gl_buffer(g_render_triangles.vertex_buffer, old_capacity * (sizeof(float2) + sizeof(float3)),
+                         capacity * (sizeof(float2) + sizeof(float3)), GL_STREAM_DRAW, moves, 2);
+        g_render_triangles.vertex_capacity = capacity;
+
+        // Colors are stored after all positions, so their offset moves with the capacity
+        GLint colorAttrib = GL_CALL(glGetAttribLocation(g_render_triangles.shader, "colorVertex"));
+        GL_CALL(glBindVertexArray(g_render_triangles.vao));
+        GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, g_render_triangles.vertex_buffer));
+        GL_CALL(glVertexAttribPointer(colorAttrib, 3, GL_FLOAT, GL_FALSE, sizeof(float3), (void*)(capacity*sizeof(float2))));
+    }
+
+    needed = g_render_triangles.n_indices + n_indices;
+    if (needed > g_render_triangles.index_capacity)
+    {
+        u32 old_capacity = g_render_triangles.index_capacity;
+        u32 capacity = grow_capacity(old_capacity, needed);
+        buffer_move move = { 0, 0, g_render_triangles.n_indices * sizeof(GLuint) };
+        resize_gl_buffer(g_render_triangles.index_buffer, old_capacity * sizeof(GLuint), capacity * sizeof(GLuint), GL_STREAM_DRAW, &move, 1);
+        g_render_triangles.index_capacity = capacity;
+    }
+}
+
+static void reserve_text(u32 n_vertices, u32 n_indices)
+{
+    u32 needed = g_render_text.n_vertices + n_vertices;
+    if (needed > g_render_text.vertex_capacity)
+    {
+        u32 old_capacity = g_render_text.vertex_capacity;
+        u32 capacity = grow_capacity(old_capacity, needed);
+        buffer_move move = { 0, 0, g_render_text.n_vertices * sizeof(text_vertex) };
+        resize_gl_buffer(g_render_text.vertex_buffer, old_capacity * sizeof(text_vertex), capacity * sizeof(text_vertex), GL_DYNAMIC_DRAW, &move, 1);
+        g_render_text.vertex_capacity = capacity;
+    }
+
+    needed = g_render_text.n_indices + n_indices;
+    if (needed > g_render_text.index_capacity)
+    {
+        u32 old_capacity = g_render_text.index_capacity;
+        u32 capacity = grow_capacity(old_capacity, needed);
+        buffer_move move = { 0, 0, g_render_text.n_indices * sizeof(GLuint) };
+        resize_gl_buffer(g_render_text.index_buffer, old_capacity * sizeof(GLuint), capacity * sizeof(GLuint), GL_DYNAMIC_DRAW, &move, 1);
+        g_render_text.index_capacity = capacity;
+    }
+}
+
 void draw_rect(float2 top_left, float2 size, float3 col)
 {
     float2 a = top_left;
     float2 b = {top_left.x + size.x, top_left.y};
-    float2 c = {top_left.x + size.x, top_left.y - size.y};
-    float2 d = {top_left.x, top_left.y - size.y};
+    float2 c = {top_left.x + size.x, top_left.y - size.y * y_up()};
+    float2 d = {top_left.x, top_left.y - size.y * y_up()};
     draw_quad(a, b, c, d, col);
 }
 
-void draw_quad(float2 a, float2 b, float2 c, float2 d, float3 col)
+static void push_quad_dl(draw_list *list, float2 a, float2 b, float2 c, float2 d, float3 col);
+
+// draw_quad without capturing, for draws that are captured as a whole (tilemaps)
+static void push_quad(float2 a, float2 b, float2 c, float2 d, float3 col)
 {
+    if (g_record_packet != NULL)
+    {
+        push_quad_dl(g_record_packet->list, a, b, c, d, col);
+        return;
+    }
+
+    if (g_backend == RENDER_BACKEND_SOFTWARE)
+    {
+        // Same split as the index buffer below
+        sw_push_triangle(a, b, c, col);
+        sw_push_triangle(c, d, a, col);
+        return;
+    }
+
     // =====================================================
     // =============== VERTICES
     // =====================================================
 
+    begin_batch(BATCH_TRIANGLES);
+    reserve_triangles(4, 6);
+
     // TODO: Use named buffer subdata to avoid mapping/unmapping buffer
     GL_CALL(glBindVertexArray(g_render_triangles.vao));
     GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, g_render_triangles.vertex_buffer));
     GL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_render_triangles.index_buffer));
 
-    // Check if vertex buffer is large enough
-    i32 vertex_buffer_capacity;
-    GL_CALL(glGetBufferParameteriv(GL_ARRAY_BUFFER, GL_BUFFER_SIZE, &vertex_buffer_capacity));
-    // printf("vertex_buffer_capacity: %zd\n", vertex_buffer_capacity);
-    if (g_render_triangles.n_vertices + 4 > vertex_buffer_capacity / (5*sizeof(float))) {
-        printf("Vertex buffer overflow, increase vertex buffer size\n");
-        abort();
-    }
-
-    // Check if index buffer is large enough
-    i32 index_buffer_capacity;
-    GL_CALL(glGetBufferParameteriv(GL_ELEMENT_ARRAY_BUFFER, GL_BUFFER_SIZE, &index_buffer_capacity));
-    if (g_render_triangles.n_indices + 6 > index_buffer_capacity / sizeof(GLuint)) {
-        printf("Index buffer overflow, increase index buffer size\n");
-        abort();
-    }
-
     // Vertices (Eckpunkte) to draw rectangle from two triangles
     // Gives only 4 cornes of rectangle, as top-left and bottom-right vertice
     // are shared by both triangles, reuse of these points is done via 'elements' array
@@ -453,7 +1838,7 @@ void draw_quad(float2 a, float2 b, float2 c, float2 d, float3 col)
     //     col,
     // };
     // int n_triangles = g_render_triangles.n_vertices / 6;
-    GLintptr offset = sizeof(float2) * PREALLOC_VERTICES + g_render_triangles.n_vertices * sizeof(float3);
+    GLintptr offset = sizeof(float2) * g_render_triangles.vertex_capacity + g_render_triangles.n_vertices * sizeof(float3);
     // printf("offset: %zd\n", offset);
     GL_CALL(glBufferSubData(GL_ARRAY_BUFFER, offset, sizeof(colors), colors));
 
@@ -471,53 +1856,94 @@ void draw_quad(float2 a, float2 b, float2 c, float2 d, float3 col)
     g_render_triangles.n_indices += 6;
 }
 
-// void draw_triangle(float2 a, float2 b, float2 c, float3 col)
-// {
-//     // TODO
-// }
+void draw_quad(float2 a, float2 b, float2 c, float2 d, float3 col)
+{
+    if (g_record_packet != NULL)
+    {
+        draw_quad_dl(g_record_packet->list, a, b, c, d, col);
+        return;
+    }
+
+    if (capture_file_is_open())
+    {
+        capture_quad(&g_capture, a, b, c, d, col);
+    }
+    push_quad(a, b, c, d, col);
+}
+
+// Quad for the i-th character of a string laid out in the given mode and drawable pixels per window
+// pixel, only reads the glyph table, safe to call from any thread
+static void glyph_quad(float2 pos, float size, float3 col, size_t i, unsigned char c, coord_mode coords, float dpi,
+                       text_vertex out[4])
+{
+    float height = size * y_up_in(coords);
+    if (coords == COORDS_PIXELS)
+    {
+        // Glyph edges on the drawable's pixel grid, so the bitmap font isn't resampled across pixels
+        pos = FLOAT2(roundf(pos.x * dpi) / dpi, roundf(pos.y * dpi) / dpi);
+        size = fmaxf(roundf(size * dpi), 1.f) / dpi;
+        height = -size;
+    }
+
+    float2 vertices[4] = {
+        {pos.x + i * size, pos.y + height},  // top left
+        {pos.x + i * size + size, pos.y + height}, // top right
+        {pos.x + i * size + size, pos.y}, // bottom right
+        {pos.x + i * size, pos.y}, // bottom left
+    };
+
+    glyph_uv glyph = g_render_text.glyphs[c % ASSET_CACHE_GLYPHS];
+    float2 bitmapPos = glyph.uv;
+
+    float2 bitmap_vertices[4] = {
+        {bitmapPos.x, bitmapPos.y},  // top left
+        {bitmapPos.x + glyph.size.x, bitmapPos.y}, // top right
+        {bitmapPos.x + glyph.size.x, bitmapPos.y + glyph.size.y}, // bottom right
+        {bitmapPos.x, bitmapPos.y + glyph.size.y}, // bottom left
+    };
+
+    for (int v = 0; v < 4; v++) {
+        out[v].pos = vertices[v];
+        out[v].tex = bitmap_vertices[v];
+        out[v].col = col;
+    }
+}
 
 void draw_text(float2 pos, float size, float3 col, const char *text)
 {
-    const char TOP_LEFT = '!' - 1;
-    const int CELLS_PER_ROW = 16;
-    const int CELLS_PER_COLUMN = 8;
-    const float CELL_WIDTH_UV = 1.0f / CELLS_PER_ROW / 2.f;
-    const float CELL_HEIGHT_UV = 1.0f / CELLS_PER_COLUMN;
+    if (g_record_packet != NULL)
+    {
+        draw_text_dl(g_record_packet->list, pos, size, col, text);
+        return;
+    }
 
-    size_t len = strlen(text);
+    if (capture_file_is_open())
+    {
+        capture_text(&g_capture, pos, size, col, text);
+    }
 
-    // TODO: check vertex / index buffer overflows
+    size_t len = strlen(text);
+    if (g_backend != RENDER_BACKEND_SOFTWARE)
+    {
+        begin_batch(BATCH_TEXT);
+        reserve_text((u32)len * 4, (u32)len * 6);
+    }
 
     for (size_t i = 0; i < len; i++) {
-        char c = text[i];
+        unsigned char c = (unsigned char)text[i];
         if (c == ' ') {
             continue;
         }
 
-        float2 vertices[4] = {
-            {pos.x + i * size, pos.y + size},  // top left
-            {pos.x + i * size + size, pos.y + size}, // top right
-            {pos.x + i * size + size, pos.y}, // bottom right
-            {pos.x + i * size, pos.y}, // bottom left
-        };
-
-        c -= TOP_LEFT;
-        float2 bitmapPos = FLOAT2(c % CELLS_PER_ROW, c / CELLS_PER_ROW);
-        bitmapPos = divf2(bitmapPos, FLOAT2(CELLS_PER_ROW, CELLS_PER_COLUMN));
-
-        float2 bitmap_vertices[4] = {
-            {bitmapPos.x, bitmapPos.y},  // top left
-            {bitmapPos.x + CELL_WIDTH_UV, bitmapPos.y}, // top right
-            {bitmapPos.x + CELL_WIDTH_UV, bitmapPos.y + CELL_HEIGHT_UV}, // bottom right
-            {bitmapPos.x, bitmapPos.y + CELL_HEIGHT_UV}, // bottom left
-        };
+        text_vertex vs[4];
+        glyph_quad(pos, size, col, i, c, g_coords, dpi_scale(), vs);
 
-        text_vertex vs[4] = {
-            {vertices[0], bitmap_vertices[0], col},
-            {vertices[1], bitmap_vertices[1], col},
-            {vertices[2], bitmap_vertices[2], col},
-            {vertices[3], bitmap_vertices[3], col},
-        };
+        if (g_backend == RENDER_BACKEND_SOFTWARE)
+        {
+            sw_push_text_triangle(vs[0].pos, vs[1].pos, vs[2].pos, vs[0].tex, vs[1].tex, vs[2].tex, col);
+            sw_push_text_triangle(vs[2].pos, vs[3].pos, vs[0].pos, vs[2].tex, vs[3].tex, vs[0].tex, col);
+            continue;
+        }
 
         size_t offset = g_render_text.n_vertices * sizeof(text_vertex);
         GL_CALL(glNamedBufferSubData(g_render_text.vertex_buffer, offset, sizeof(vs), vs));
@@ -567,3 +1993,1591 @@ void draw_textf_i(float2 pos, float size, float3 col, const char* fmt, ...)
     draw_text(pos, size, col, large_buf);
     free(large_buf);
 }
+
+void read_framebuffer(rgba *pixels)
+{
+    do_render();
+
+    int2 size = g_drawable_size;
+    size_t row_size = size.x * sizeof(rgba);
+    if (g_backend == RENDER_BACKEND_SOFTWARE)
+    {
+        memcpy(pixels, sw_framebuffer(), row_size * size.y);
+        return;
+    }
+
+    GL_CALL(glPixelStorei(GL_PACK_ALIGNMENT, 4));
+    GL_CALL(glReadPixels(0, 0, size.x, size.y, GL_RGBA, GL_UNSIGNED_BYTE, pixels));
+
+    // GL rows start at the bottom
+    rgba *tmp = malloc(row_size);
+    for (int y = 0; y < size.y / 2; y++)
+    {
+        rgba *top = pixels + (size_t)y * size.x;
+        rgba *bottom = pixels + (size_t)(size.y - 1 - y) * size.x;
+        memcpy(tmp, top, row_size);
+        memcpy(top, bottom, row_size);
+        memcpy(bottom, tmp, row_size);
+    }
+    free(tmp);
+}
+
+// =====================================================
+// =============== TILEMAPS
+// =====================================================
+
+// Palette colors outside of [0, 1] saturate like they do in the shaders
+static unsigned char to_unorm8(float f)
+{
+    if (!(f > 0.f)) return 0;
+    if (f >= 1.f) return 255;
+    return (unsigned char)(f * 255.f + 0.5f);
+}
+
+tilemap *tilemap_create(int2 cells, const float3 *palette, int n_colors)
+{
+    if (cells.x <= 0 || cells.y <= 0 || n_colors <= 0 || n_colors > MAX_TILEMAP_COLORS)
+    {
+        printf("Invalid tilemap: %dx%d cells, %d colors\n", cells.x, cells.y, n_colors);
+        abort();
+    }
+
+    static u32 next_id = 1;
+    tilemap *map = calloc(1, sizeof(tilemap));
+    map->id = next_id++;
+    map->cells = cells;
+    map->states = calloc((size_t)cells.x * cells.y, 1);
+    map->dirty_min = malloc(cells.y * sizeof(int));
+    map->dirty_max = malloc(cells.y * sizeof(int));
+    for (int y = 0; y < cells.y; y++)
+    {
+        map->dirty_min[y] = cells.x;
+        map->dirty_max[y] = 0;
+    }
+
+    // Unused palette entries repeat the last color
+    for (int i = 0; i < MAX_TILEMAP_COLORS; i++)
+    {
+        map->palette[i] = palette[i < n_colors ? i : n_colors - 1];
+    }
+    map->n_colors = n_colors;
+
+    if (g_backend != RENDER_BACKEND_GL) return map;
+
+    rgba palette_texels[MAX_TILEMAP_COLORS];
+    for (int i = 0; i < MAX_TILEMAP_COLORS; i++)
+    {
+        float3 c = map->palette[i];
+        palette_texels[i] = (rgba){ to_unorm8(c.x), to_unorm8(c.y), to_unorm8(c.z), 255 };
+    }
+
+    GL_CALL(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
+
+    GL_CALL(glCreateTextures(GL_TEXTURE_2D, 1, &map->palette_texture));
+    GL_CALL(glTextureStorage2D(map->palette_texture, 1, GL_RGBA8, MAX_TILEMAP_COLORS, 1));
+    GL_CALL(glTextureSubImage2D(map->palette_texture, 0, 0, 0, MAX_TILEMAP_COLORS, 1, GL_RGBA, GL_UNSIGNED_BYTE, palette_texels));
+    GL_CALL(glTextureParameteri(map->palette_texture, GL_TEXTURE_MIN_FILTER, GL_NEAREST));
+    GL_CALL(glTextureParameteri(map->palette_texture, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
+    gl_label(GL_TEXTURE, map->palette_texture, "tilemap palette");
+
+    // Integer textures can't be filtered, cells are looked up with texelFetch
+    GL_CALL(glCreateTextures(GL_TEXTURE_2D, 1, &map->state_texture));
+    GL_CALL(glTextureStorage2D(map->state_texture, 1, GL_R8UI, cells.x, cells.y));
+    GL_CALL(glTextureSubImage2D(map->state_texture, 0, 0, 0, cells.x, cells.y, GL_RED_INTEGER, GL_UNSIGNED_BYTE, map->states));
+    GL_CALL(glTextureParameteri(map->state_texture, GL_TEXTURE_MIN_FILTER, GL_NEAREST));
+    GL_CALL(glTextureParameteri(map->state_texture, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
+    gl_label(GL_TEXTURE, map->state_texture, "tilemap cells");
+
+    GL_CALL(glPixelStorei(GL_UNPACK_ALIGNMENT, 4));
+    return map;
+}
+
+void tilemap_destroy(tilemap *map)
+{
+    if (map->state_texture != 0)
+    {
+        glDeleteTextures(1, &map->state_texture);
+        glDeleteTextures(1, &map->palette_texture);
+    }
+    free(map->states);
+    free(map->dirty_min);
+    free(map->dirty_max);
+    free(map);
+}
+
+void tilemap_set(tilemap *map, int2 cell, unsigned char state)
+{
+    if (cell.x < 0 || cell.y < 0 || cell.x >= map->cells.x || cell.y >= map->cells.y) return;
+
+    unsigned char *current = &map->states[(size_t)cell.y * map->cells.x + cell.x];
+    if (*current == state) return;
+    *current = state;
+
+    if (cell.x < map->dirty_min[cell.y]) map->dirty_min[cell.y] = cell.x;
+    if (cell.x + 1 > map->dirty_max[cell.y]) map->dirty_max[cell.y] = cell.x + 1;
+    map->dirty = true;
+}
+
+unsigned char tilemap_get(const tilemap *map, int2 cell)
+{
+    if (cell.x < 0 || cell.y < 0 || cell.x >= map->cells.x || cell.y >= map->cells.y) return 0;
+    return map->states[(size_t)cell.y * map->cells.x + cell.x];
+}
+
+void tilemap_update(tilemap *map, const unsigned char *states)
+{
+    for (int y = 0; y < map->cells.y; y++)
+    {
+        for (int x = 0; x < map->cells.x; x++)
+        {
+            tilemap_set(map, INT2(x, y), states[(size_t)y * map->cells.x + x]);
+        }
+    }
+}
+
+// One glTextureSubImage2D per row with changes, covering only the changed span
+static void upload_tilemap(tilemap *map)
+{
+    if (!map->dirty) return;
+    map->dirty = false;
+
+    GL_CALL(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
+    for (int y = 0; y < map->cells.y; y++)
+    {
+        int x0 = map->dirty_min[y];
+        int x1 = map->dirty_max[y];
+        if (x0 >= x1) continue;
+
+        const unsigned char *row = map->states + (size_t)y * map->cells.x;
+        GL_CALL(glTextureSubImage2D(map->state_texture, 0, x0, y, x1 - x0, 1, GL_RED_INTEGER, GL_UNSIGNED_BYTE, row + x0));
+        map->dirty_min[y] = map->cells.x;
+        map->dirty_max[y] = 0;
+    }
+    GL_CALL(glPixelStorei(GL_UNPACK_ALIGNMENT, 4));
+}
+
+static bool tilemap_draw_pending(const tilemap *map)
+{
+    for (u32 i = g_rendered.tilemap_draws; i < g_render_tilemaps.n_draws; i++)
+    {
+        if (g_render_tilemaps.draws[i].map == map) return true;
+    }
+    return false;
+}
+
+void draw_tilemap(tilemap *map, float2 top_left, float2 size)
+{
+    // One op with the cell states instead of a quad per cell, pipelined draws are captured
+    // with the packet so they stay in order
+    if (capture_file_is_open())
+    {
+        capture_buffer *buf = g_record_packet != NULL ? &g_record_packet->list->ops : &g_capture;
+        capture_tilemap(buf, map->id, map->cells, map->palette, map->n_colors, map->states, top_left, size);
+    }
+
+    // Cell states can't be uploaded from here without racing the render thread, and the
+    // software rasterizer has no cell texture. Inside a cache recording an earlier draw of
+    // the map can't be rendered ahead, see below.
+    bool recording = g_render_caches.recording != NULL && !g_render_caches.recording->passthrough;
+    if (g_backend != RENDER_BACKEND_GL || g_record_packet != NULL || (recording && map->dirty && tilemap_draw_pending(map)))
+    {
+        float2 cell_size = FLOAT2(size.x / map->cells.x, size.y / map->cells.y);
+        for (int y = 0; y < map->cells.y; y++)
+        {
+            for (int x = 0; x < map->cells.x; x++)
+            {
+                float2 pos = FLOAT2(top_left.x + x * cell_size.x, top_left.y - y * cell_size.y * y_up());
+                float2 end = FLOAT2(pos.x + cell_size.x, pos.y - cell_size.y * y_up());
+                push_quad(pos, FLOAT2(end.x, pos.y), end, FLOAT2(pos.x, end.y), map->palette[map->states[(size_t)y * map->cells.x + x]]);
+            }
+        }
+        return;
+    }
+
+    if (g_render_tilemaps.n_draws == MAX_TILEMAP_DRAWS)
+    {
+        printf("Too many tilemap draws, increase MAX_TILEMAP_DRAWS\n");
+        abort();
+    }
+    // Like the quads above the draw shows the cells as they are now: changes since an earlier,
+    // not yet rendered draw of the map would show up in that one too, so it is rendered first
+    if (map->dirty && tilemap_draw_pending(map))
+    {
+        do_render();
+    }
+    upload_tilemap(map);
+
+    begin_batch(BATCH_TILEMAPS);
+    g_render_tilemaps.draws[g_render_tilemaps.n_draws].map = map;
+    g_render_tilemaps.draws[g_render_tilemaps.n_draws].top_left = top_left;
+    // Rows go down the screen, which is -y in NDC and +y in pixels
+    g_render_tilemaps.draws[g_render_tilemaps.n_draws].size = FLOAT2(size.x, size.y * y_up());
+    g_render_tilemaps.n_draws++;
+}
+
+// =====================================================
+// =============== PARTICLES
+// =====================================================
+
+// Also used by the emit shader, keep both in sync
+static u32 particle_hash(u32 x)
+{
+    x ^= x >> 16; x *= 0x7feb352du;
+    x ^= x >> 15; x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+static float particle_rand(u32 *state)
+{
+    *state = particle_hash(*state);
+    return (*state >> 8) * (2.f / 16777216.f) - 1.f;
+}
+
+static void spawn_particle(particle *p, const particle_emit_params *params, u32 state)
+{
+    float px = particle_rand(&state);
+    float py = particle_rand(&state);
+    float vx = particle_rand(&state);
+    float vy = particle_rand(&state);
+    float life = particle_rand(&state);
+
+    memset(p, 0, sizeof(*p));
+    p->pos = FLOAT2(params->position.x + px * params->position_spread.x, params->position.y + py * params->position_spread.y);
+    p->vel = FLOAT2(params->velocity.x + vx * params->velocity_spread.x, params->velocity.y + vy * params->velocity_spread.y);
+    p->color_start = params->color_start;
+    p->size = params->size;
+    p->color_end = params->color_end;
+    p->lifetime = params->lifetime + life * params->lifetime_spread;
+    if (p->lifetime < 0.f) p->lifetime = 0.f;
+}
+
+particle_system *particles_create(u32 max_particles)
+{
+    if (max_particles == 0)
+    {
+        printf("Invalid particle system with 0 particles\n");
+        abort();
+    }
+
+    particle_system *ps = calloc(1, sizeof(particle_system));
+    ps->capacity = max_particles;
+    ps->seed = particle_hash((u32)SDL_GetPerformanceCounter());
+
+    if (!g_render_particles.gpu)
+    {
+        ps->particles = calloc(max_particles, sizeof(particle));
+        return ps;
+    }
+
+    // Zeroed particles are dead, this is the only time the buffer is touched from the CPU
+    GL_CALL(glCreateBuffers(1, &ps->buffer));
+    GL_CALL(glNamedBufferStorage(ps->buffer, (GLsizeiptr)max_particles * sizeof(particle), NULL, 0));
+    GL_CALL(glClearNamedBufferData(ps->buffer, GL_R32F, GL_RED, GL_FLOAT, NULL));
+    gl_label(GL_BUFFER, ps->buffer, "particles");
+    return ps;
+}
+
+void particles_destroy(particle_system *ps)
+{
+    if (ps->buffer != 0) glDeleteBuffers(1, &ps->buffer);
+    free(ps->particles);
+    free(ps);
+}
+
+void particles_set_update(particle_system *ps, const particle_update_params *params)
+{
+    ps->update = *params;
+}
+
+void particles_emit(particle_system *ps, const particle_emit_params *params, u32 count)
+{
+    if (count > ps->capacity) count = ps->capacity;
+    if (count == 0) return;
+
+    if (ps->n_pending == MAX_PARTICLE_EMITS)
+    {
+        printf("Too many particle emits per frame, increase MAX_PARTICLE_EMITS\n");
+        abort();
+    }
+    particle_emit *emit = &ps->pending[ps->n_pending++];
+    emit->params = *params;
+    emit->first = ps->cursor;
+    emit->count = count;
+    emit->seed = ps->seed;
+    ps->cursor = (ps->cursor + count) % ps->capacity;
+    ps->seed = particle_hash(ps->seed);
+}
+
+static void update_particles_cpu(particle_system *ps, float dt)
+{
+    for (u32 e = 0; e < ps->n_pending; e++)
+    {
+        const particle_emit *emit = &ps->pending[e];
+        for (u32 i = 0; i < emit->count; i++)
+        {
+            u32 state = particle_hash(emit->seed + i * 0x9e3779b9u);
+            spawn_particle(&ps->particles[(emit->first + i) % ps->capacity], &emit->params, state);
+        }
+    }
+
+    float damping = 1.f - ps->update.drag * dt;
+    if (damping < 0.f) damping = 0.f;
+    for (u32 i = 0; i < ps->capacity; i++)
+    {
+        particle *p = &ps->particles[i];
+        if (!(p->age < p->lifetime)) continue;
+        p->vel.x = (p->vel.x + ps->update.gravity.x * dt) * damping;
+        p->vel.y = (p->vel.y + ps->update.gravity.y * dt) * damping;
+        p->pos.x += p->vel.x * dt;
+        p->pos.y += p->vel.y * dt;
+        p->age += dt;
+    }
+}
+
+// CPU path, live particles become quads on the software backend and instances on GL.
+// Neither is captured, same as the GPU path.
+static void draw_particles_cpu(particle_system *ps, particle_draw *draw)
+{
+    if (g_backend == RENDER_BACKEND_SOFTWARE)
+    {
+        for (u32 i = 0; i < ps->capacity; i++)
+        {
+            const particle *p = &ps->particles[i];
+            if (!(p->age < p->lifetime)) continue;
+            float t = p->age / p->lifetime;
+            float3 col = RGB(p->color_start.x + (p->color_end.x - p->color_start.x) * t,
+                             p->color_start.y + (p->color_end.y - p->color_start.y) * t,
+                             p->color_start.z + (p->color_end.z - p->color_start.z) * t);
+            float half = 0.5f * p->size;
+            push_quad(FLOAT2(p->pos.x - half, p->pos.y + half), FLOAT2(p->pos.x + half, p->pos.y + half),
+                      FLOAT2(p->pos.x + half, p->pos.y - half), FLOAT2(p->pos.x - half, p->pos.y - half), col);
+        }
+        return;
+    }
+
+    // In pipelined mode the instances go with the packet, see render_thread_main
+    particle_instance **instances = g_record_packet != NULL ? &g_record_packet->particle_instances : &g_render_particles.instances;
+    u32 *n_instances = g_record_packet != NULL ? &g_record_packet->n_particle_instances : &g_render_particles.n_instances;
+    u32 *capacity = g_record_packet != NULL ? &g_record_packet->particle_instance_capacity : &g_render_particles.instance_capacity;
+    *instances = grow_array(*instances, capacity, *n_instances + ps->capacity, sizeof(particle_instance));
+
+    if (g_record_packet == NULL) g_render_particles.instances_uploaded = false;
+    draw->first_instance = *n_instances;
+    for (u32 i = 0; i < ps->capacity; i++)
+    {
+        const particle *p = &ps->particles[i];
+        if (!(p->age < p->lifetime)) continue;
+        float t = p->age / p->lifetime;
+        particle_instance *instance = &(*instances)[(*n_instances)++];
+        instance->pos = p->pos;
+        instance->size = p->size;
+        instance->col = RGB(p->color_start.x + (p->color_end.x - p->color_start.x) * t,
+                            p->color_start.y + (p->color_end.y - p->color_start.y) * t,
+                            p->color_start.z + (p->color_end.z - p->color_start.z) * t);
+        instance->alpha = 1.f - t;
+    }
+    draw->n_instances = *n_instances - draw->first_instance;
+}
+
+void draw_particles(particle_system *ps, float dt)
+{
+    if (!g_render_particles.gpu)
+    {
+        update_particles_cpu(ps, dt);
+        ps->n_pending = 0;
+        if (g_backend == RENDER_BACKEND_SOFTWARE)
+        {
+            draw_particles_cpu(ps, NULL);
+            return;
+        }
+    }
+
+    // In pipelined mode the step runs on the render thread with the packet
+    particle_draw *draws = g_record_packet != NULL ? g_record_packet->particle_draws : g_render_particles.draws;
+    u32 *n_draws = g_record_packet != NULL ? &g_record_packet->n_particle_draws : &g_render_particles.n_draws;
+    if (*n_draws == MAX_PARTICLE_DRAWS)
+    {
+        printf("Too many particle draws, increase MAX_PARTICLE_DRAWS\n");
+        abort();
+    }
+
+    if (g_record_packet != NULL)
+    {
+        list_add_batch(g_record_packet->list, BATCH_PARTICLES, g_record_packet->list->coords, *n_draws, 1);
+    }
+    else
+    {
+        begin_batch(BATCH_PARTICLES);
+    }
+    particle_draw *draw = &draws[(*n_draws)++];
+    draw->ps = ps;
+    if (!g_render_particles.gpu)
+    {
+        // Already stepped, only the instances are drawn
+        draw->dt = 0.f;
+        draw->n_emits = 0;
+        draw_particles_cpu(ps, draw);
+        return;
+    }
+
+    draw->dt = dt;
+    draw->update = ps->update;
+    draw->n_emits = ps->n_pending;
+    memcpy(draw->emits, ps->pending, ps->n_pending * sizeof(particle_emit));
+    draw->n_instances = 0;
+    ps->n_pending = 0;
+}
+
+static void render_particles(const frame_mark *from, const frame_mark *to)
+{
+    u32 first_draw = from->particle_draws;
+    u32 end_draw = to->particle_draws;
+    if (end_draw <= first_draw) return;
+
+    if (!g_render_particles.gpu)
+    {
+        if (to->particle_instances <= from->particle_instances) return;
+
+        // Orphaned like the shape instances, the draws of the range are contiguous
+        if (!g_render_particles.instances_uploaded)
+        {
+            GL_CALL(glNamedBufferData(g_render_particles.instance_buffer, g_render_particles.n_instances * sizeof(particle_instance),
+                                      g_render_particles.instances, GL_STREAM_DRAW));
+            g_render_particles.instances_uploaded = true;
+        }
+        GL_CALL(glBindVertexArray(g_render_particles.vao));
+        GL_CALL(glUseProgram(g_render_particles.shader));
+        GL_CALL(glDrawArraysInstancedBaseInstance(GL_TRIANGLE_STRIP, 0, 4, to->particle_instances - from->particle_instances,
+                                                  from->particle_instances));
+        return;
+    }
+
+    for (u32 i = first_draw; i < end_draw; i++)
+    {
+        particle_draw *draw = &g_render_particles.draws[i];
+        GL_CALL(glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, draw->ps->buffer));
+
+        if (draw->n_emits > 0)
+        {
+            GL_CALL(glUseProgram(g_render_particles.emit_shader));
+            // Emits wrap around the ring, once they add up to more than the capacity a later one
+            // overwrites slots of an earlier one and has to wait for it, so the later one wins like on the CPU
+            u32 emitted = 0;
+            for (u32 e = 0; e < draw->n_emits; e++)
+            {
+                const particle_emit *emit = &draw->emits[e];
+                const particle_emit_params *params = &emit->params;
+                if (emitted + emit->count > draw->ps->capacity)
+                {
+                    GL_CALL(glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT));
+                    emitted = 0;
+                }
+                emitted += emit->count;
+                GL_CALL(glUniform1ui(g_render_particles.loc_emit_first, emit->first));
+                GL_CALL(glUniform1ui(g_render_particles.loc_emit_count, emit->count));
+                GL_CALL(glUniform1ui(g_render_particles.loc_emit_seed, emit->seed));
+                GL_CALL(glUniform2f(g_render_particles.loc_emit_position, params->position.x, params->position.y));
+                GL_CALL(glUniform2f(g_render_particles.loc_emit_position_spread, params->position_spread.x, params->position_spread.y));
+                GL_CALL(glUniform2f(g_render_particles.loc_emit_velocity, params->velocity.x, params->velocity.y));
+                GL_CALL(glUniform2f(g_render_particles.loc_emit_velocity_spread, params->velocity_spread.x, params->velocity_spread.y));
+                GL_CALL(glUniform2f(g_render_particles.loc_emit_lifetime, params->lifetime, params->lifetime_spread));
+                GL_CALL(glUniform1f(g_render_particles.loc_emit_size, params->size));
+                GL_CALL(glUniform3f(g_render_particles.loc_emit_color_start, params->color_start.x, params->color_start.y, params->color_start.z));
+                GL_CALL(glUniform3f(g_render_particles.loc_emit_color_end, params->color_end.x, params->color_end.y, params->color_end.z));
+                GL_CALL(glDispatchCompute((emit->count + PARTICLE_GROUP_SIZE - 1) / PARTICLE_GROUP_SIZE, 1, 1));
+            }
+            GL_CALL(glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT));
+        }
+
+        if (draw->dt > 0.f)
+        {
+            GL_CALL(glUseProgram(g_render_particles.update_shader));
+            GL_CALL(glUniform1f(g_render_particles.loc_update_dt, draw->dt));
+            GL_CALL(glUniform2f(g_render_particles.loc_update_gravity, draw->update.gravity.x, draw->update.gravity.y));
+            GL_CALL(glUniform1f(g_render_particles.loc_update_drag, draw->update.drag));
+            GL_CALL(glDispatchCompute((draw->ps->capacity + PARTICLE_GROUP_SIZE - 1) / PARTICLE_GROUP_SIZE, 1, 1));
+        }
+
+        // Rendering the same frame again (read_framebuffer) must not step the simulation twice
+        draw->n_emits = 0;
+        draw->dt = 0.f;
+    }
+
+    GL_CALL(glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT));
+
+    GL_CALL(glBindVertexArray(g_render_particles.vao));
+    GL_CALL(glUseProgram(g_render_particles.shader));
+    for (u32 i = first_draw; i < end_draw; i++)
+    {
+        particle_system *ps = g_render_particles.draws[i].ps;
+        GL_CALL(glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, ps->buffer));
+        GL_CALL(glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, ps->capacity));
+    }
+}
+
+// =====================================================
+// =============== DRAW LISTS
+// =====================================================
+
+static void *grow_array(void *data, u32 *capacity, u32 needed, size_t element_size)
+{
+    if (needed <= *capacity) return data;
+
+    u32 new_capacity = *capacity ? *capacity : PREALLOC_VERTICES;
+    while (new_capacity < needed) new_capacity *= 2;
+
+    data = realloc(data, new_capacity * element_size);
+    if (data == NULL)
+    {
+        printf("Draw list: out of memory\n");
+        abort();
+    }
+    *capacity = new_capacity;
+    return data;
+}
+
+draw_list *draw_list_create()
+{
+    draw_list *list = calloc(1, sizeof(draw_list));
+    list->coords = g_coords;
+    list->dpi_scale = dpi_scale();
+    return list;
+}
+
+void draw_list_destroy(draw_list *list)
+{
+    free(list->positions);
+    free(list->colors);
+    free(list->indices);
+    free(list->text_vertices);
+    free(list->text_indices);
+    free(list->batches);
+    capture_buffer_free(&list->ops);
+    free(list);
+}
+
+void draw_list_reset(draw_list *list)
+{
+    list->n_vertices = 0;
+    list->n_indices = 0;
+    list->n_text_vertices = 0;
+    list->n_text_indices = 0;
+    list->n_batches = 0;
+    list->coords = g_coords;
+    list->dpi_scale = dpi_scale();
+    capture_buffer_reset(&list->ops);
+}
+
+// Extends the last batch if it is of the same kind and mode and ends at first
+static void list_add_batch(draw_list *list, batch_kind kind, coord_mode coords, u32 first, u32 count)
+{
+    if (list->n_batches > 0)
+    {
+        list_batch *last = &list->batches[list->n_batches - 1];
+        if (last->kind == kind && last->coords == coords && last->first + last->count == first)
+        {
+            last->count += count;
+            return;
+        }
+    }
+    list->batches = grow_array(list->batches, &list->batch_capacity, list->n_batches + 1, sizeof(list_batch));
+    list->batches[list->n_batches++] = (list_batch){ kind, coords, first, count };
+}
+
+void draw_rect_dl(draw_list *list, float2 top_left, float2 size, float3 col)
+{
+    float2 a = top_left;
+    float2 b = {top_left.x + size.x, top_left.y};
+    float2 c = {top_left.x + size.x, top_left.y - size.y * y_up_in(list->coords)};
+    float2 d = {top_left.x, top_left.y - size.y * y_up_in(list->coords)};
+    draw_quad_dl(list, a, b, c, d, col);
+}
+
+void draw_quad_dl(draw_list *list, float2 a, float2 b, float2 c, float2 d, float3 col)
+{
+    if (capture_file_is_open())
+    {
+        capture_quad(&list->ops, a, b, c, d, col);
+    }
+    push_quad_dl(list, a, b, c, d, col);
+}
+
+static void push_quad_dl(draw_list *list, float2 a, float2 b, float2 c, float2 d, float3 col)
+{
+    // positions and colors share one capacity, both grow in lockstep
+    u32 needed = list->n_vertices + 4;
+    u32 capacity = list->vertex_capacity;
+    list->positions = grow_array(list->positions, &capacity, needed, sizeof(float2));
+    list->colors = grow_array(list->colors, &list->vertex_capacity, needed, sizeof(float3));
+    list->indices = grow_array(list->indices, &list->index_capacity, list->n_indices + 6, sizeof(GLuint));
+
+    GLuint nv = list->n_vertices;
+    float2 *pos = list->positions + nv;
+    pos[0] = a; pos[1] = b; pos[2] = c; pos[3] = d;
+    float3 *colors = list->colors + nv;
+    colors[0] = col; colors[1] = col; colors[2] = col; colors[3] = col;
+
+    GLuint *indices = list->indices + list->n_indices;
+    indices[0] = nv + 0; indices[1] = nv + 1; indices[2] = nv + 2;
+    indices[3] = nv + 2; indices[4] = nv + 3; indices[5] = nv + 0;
+
+    list_add_batch(list, BATCH_TRIANGLES, list->coords, list->n_indices, 6);
+    list->n_vertices += 4;
+    list->n_indices += 6;
+}
+
+void draw_text_dl(draw_list *list, float2 pos, float size, float3 col, const char *text)
+{
+    if (capture_file_is_open())
+    {
+        capture_text(&list->ops, pos, size, col, text);
+    }
+
+    size_t len = strlen(text);
+    list->text_vertices = grow_array(list->text_vertices, &list->text_vertex_capacity, list->n_text_vertices + (u32)len * 4, sizeof(text_vertex));
+    list->text_indices = grow_array(list->text_indices, &list->text_index_capacity, list->n_text_indices + (u32)len * 6, sizeof(GLuint));
+
+    u32 first_index = list->n_text_indices;
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)text[i];
+        if (c == ' ') {
+            continue;
+        }
+
+        GLuint nv = list->n_text_vertices;
+        glyph_quad(pos, size, col, i, c, list->coords, list->dpi_scale, list->text_vertices + nv);
+
+        GLuint *indices = list->text_indices + list->n_text_indices;
+        indices[0] = nv + 0; indices[1] = nv + 1; indices[2] = nv + 2;
+        indices[3] = nv + 2; indices[4] = nv + 3; indices[5] = nv + 0;
+
+        list->n_text_vertices += 4;
+        list->n_text_indices += 6;
+    }
+    if (list->n_text_indices > first_index)
+    {
+        list_add_batch(list, BATCH_TEXT, list->coords, first_index, list->n_text_indices - first_index);
+    }
+}
+
+// Indices are stored relative to their list and rebased onto the frame while uploading
+static void upload_indices(glid buffer, u32 first_index, const GLuint *indices, u32 n_indices, GLuint base_vertex)
+{
+    GLuint rebased[1024];
+    for (u32 done = 0; done < n_indices; ) {
+        u32 n = n_indices - done < 1024 ? n_indices - done : 1024;
+        for (u32 i = 0; i < n; i++) rebased[i] = indices[done + i] + base_vertex;
+        GL_CALL(glNamedBufferSubData(buffer, (first_index + done) * sizeof(GLuint), n * sizeof(GLuint), rebased));
+        done += n;
+    }
+}
+
+void submit_draw_list(const draw_list *list)
+{
+    // Inside a pipelined tick the list becomes part of the frame packet
+    if (g_record_packet != NULL)
+    {
+        draw_list_append(g_record_packet->list, list);
+        return;
+    }
+
+    if (capture_file_is_open())
+    {
+        capture_buffer_append(&g_capture, &list->ops);
+    }
+    upload_draw_list(list, NULL);
+}
+
+static void draw_list_append(draw_list *dst, const draw_list *src)
+{
+    u32 capacity = dst->vertex_capacity;
+    dst->positions = grow_array(dst->positions, &capacity, dst->n_vertices + src->n_vertices, sizeof(float2));
+    dst->colors = grow_array(dst->colors, &dst->vertex_capacity, dst->n_vertices + src->n_vertices, sizeof(float3));
+    dst->indices = grow_array(dst->indices, &dst->index_capacity, dst->n_indices + src->n_indices, sizeof(GLuint));
+    dst->text_vertices = grow_array(dst->text_vertices, &dst->text_vertex_capacity, dst->n_text_vertices + src->n_text_vertices, sizeof(text_vertex));
+    dst->text_indices = grow_array(dst->text_indices, &dst->text_index_capacity, dst->n_text_indices + src->n_text_indices, sizeof(GLuint));
+
+    if (src->n_vertices > 0) {
+        memcpy(dst->positions + dst->n_vertices, src->positions, src->n_vertices * sizeof(float2));
+        memcpy(dst->colors + dst->n_vertices, src->colors, src->n_vertices * sizeof(float3));
+    }
+    for (u32 i = 0; i < src->n_indices; i++) {
+        dst->indices[dst->n_indices + i] = src->indices[i] + dst->n_vertices;
+    }
+    if (src->n_text_vertices > 0) {
+        memcpy(dst->text_vertices + dst->n_text_vertices, src->text_vertices, src->n_text_vertices * sizeof(text_vertex));
+    }
+    for (u32 i = 0; i < src->n_text_indices; i++) {
+        dst->text_indices[dst->n_text_indices + i] = src->text_indices[i] + dst->n_text_vertices;
+    }
+    // Submitted lists only hold triangles and text
+    for (u32 i = 0; i < src->n_batches; i++) {
+        const list_batch *b = &src->batches[i];
+        u32 base = b->kind == BATCH_TEXT ? dst->n_text_indices : dst->n_indices;
+        list_add_batch(dst, b->kind, b->coords, base + b->first, b->count);
+    }
+
+    dst->n_vertices += src->n_vertices;
+    dst->n_indices += src->n_indices;
+    dst->n_text_vertices += src->n_text_vertices;
+    dst->n_text_indices += src->n_text_indices;
+    capture_buffer_append(&dst->ops, &src->ops);
+}
+
+// Appends a list to the frame in its call order, with the particle draws of a frame packet
+static void upload_draw_list(const draw_list *list, const frame_packet *packet)
+{
+    if (g_backend == RENDER_BACKEND_SOFTWARE)
+    {
+        // Software particles are recorded as quads, the list only holds triangles and text
+        for (u32 i = 0; i < list->n_batches; i++) {
+            const list_batch *batch = &list->batches[i];
+            sw_select_projection((u32)batch->coords);
+            for (u32 j = batch->first; j < batch->first + batch->count; j += 3) {
+                if (batch->kind == BATCH_TEXT) {
+                    const text_vertex *a = &list->text_vertices[list->text_indices[j]];
+                    const text_vertex *b = &list->text_vertices[list->text_indices[j + 1]];
+                    const text_vertex *c = &list->text_vertices[list->text_indices[j + 2]];
+                    sw_push_text_triangle(a->pos, b->pos, c->pos, a->tex, b->tex, c->tex, a->col);
+                } else {
+                    const GLuint *t = list->indices + j;
+                    sw_push_triangle(list->positions[t[0]], list->positions[t[1]], list->positions[t[2]], list->colors[t[0]]);
+                }
+            }
+        }
+        sw_select_projection((u32)g_view_coords);
+        return;
+    }
+
+    // Where the list's draws start in the frame, advanced batch by batch below
+    frame_mark mark = current_frame_mark();
+
+    reserve_triangles(list->n_vertices, list->n_indices);
+    reserve_text(list->n_text_vertices, list->n_text_indices);
+
+    // A handful of bulk uploads instead of one per primitive
+    if (list->n_vertices > 0) {
+        GLintptr pos_offset = g_render_triangles.n_vertices * sizeof(float2);
+        GLintptr col_offset = sizeof(float2) * g_render_triangles.vertex_capacity + g_render_triangles.n_vertices * sizeof(float3);
+        GL_CALL(glNamedBufferSubData(g_render_triangles.vertex_buffer, pos_offset, list->n_vertices * sizeof(float2), list->positions));
+        GL_CALL(glNamedBufferSubData(g_render_triangles.vertex_buffer, col_offset, list->n_vertices * sizeof(float3), list->colors));
+        upload_indices(g_render_triangles.index_buffer, g_render_triangles.n_indices, list->indices, list->n_indices, g_render_triangles.n_vertices);
+        g_render_triangles.n_vertices += list->n_vertices;
+        g_render_triangles.n_indices += list->n_indices;
+    }
+
+    if (list->n_text_vertices > 0) {
+        GLintptr offset = g_render_text.n_vertices * sizeof(text_vertex);
+        GL_CALL(glNamedBufferSubData(g_render_text.vertex_buffer, offset, list->n_text_vertices * sizeof(text_vertex), list->text_vertices));
+        upload_indices(g_render_text.index_buffer, g_render_text.n_indices, list->text_indices, list->n_text_indices, g_render_text.n_vertices);
+        g_render_text.n_vertices += list->n_text_vertices;
+        g_render_text.n_indices += list->n_text_indices;
+    }
+
+    if (packet != NULL) {
+        if (g_render_particles.n_draws + packet->n_particle_draws > MAX_PARTICLE_DRAWS)
+        {
+            printf("Too many particle draws, increase MAX_PARTICLE_DRAWS\n");
+            abort();
+        }
+        // CPU path instances are appended to the frame's, their draws move along
+        for (u32 i = 0; i < packet->n_particle_draws; i++)
+        {
+            particle_draw *draw = &g_render_particles.draws[g_render_particles.n_draws++];
+            *draw = packet->particle_draws[i];
+            draw->first_instance += g_render_particles.n_instances;
+        }
+        if (packet->n_particle_instances > 0)
+        {
+            g_render_particles.instances = grow_array(g_render_particles.instances, &g_render_particles.instance_capacity,
+                                                      g_render_particles.n_instances + packet->n_particle_instances, sizeof(particle_instance));
+            memcpy(g_render_particles.instances + g_render_particles.n_instances, packet->particle_instances,
+                   packet->n_particle_instances * sizeof(particle_instance));
+            g_render_particles.n_instances += packet->n_particle_instances;
+            g_render_particles.instances_uploaded = false;
+        }
+    }
+
+    // Only the counters render_range draws from have to be exact in the batch marks
+    for (u32 i = 0; i < list->n_batches; i++) {
+        const list_batch *batch = &list->batches[i];
+        add_batch(batch->kind, batch->coords, &mark);
+        if (batch->kind == BATCH_TRIANGLES) {
+            mark.triangle_indices += batch->count;
+        } else if (batch->kind == BATCH_TEXT) {
+            mark.text_indices += batch->count;
+        } else {
+            for (u32 j = batch->first; j < batch->first + batch->count; j++) {
+                mark.particle_instances += packet->particle_draws[j].n_instances;
+            }
+            mark.particle_draws += batch->count;
+        }
+    }
+}
+
+// =====================================================
+// =============== SHAPES
+// =====================================================
+
+typedef void (*quad_func)(float2 a, float2 b, float2 c, float2 d, float3 col);
+
+// Shapes go through the regular quad path when they can't be instanced: draw lists only hold
+// quads.
+static bool shapes_tessellated()
+{
+    return g_record_packet != NULL;
+}
+
+// The shape itself is captured, not its quads, so pipelined draws go to the packet list
+// without the quad ops of draw_quad_dl
+static void push_tessellated_quad(float2 a, float2 b, float2 c, float2 d, float3 col)
+{
+    push_quad_dl(g_record_packet->list, a, b, c, d, col);
+}
+
+static capture_buffer *shape_capture_buffer()
+{
+    return g_record_packet != NULL ? &g_record_packet->list->ops : &g_capture;
+}
+
+static void tessellate_line(float2 a, float2 b, float thickness, float3 col, quad_func quad)
+{
+    float2 scale = pixels_per_unit();
+    float dx = (b.x - a.x) * scale.x;
+    float dy = (b.y - a.y) * scale.y;
+    float len = sqrtf(dx * dx + dy * dy);
+    if (len == 0.f) return;
+
+    // Normal in pixels, back to coordinate units per axis
+    float2 n = FLOAT2(-dy / len * 0.5f * thickness / scale.x, dx / len * 0.5f * thickness / scale.y);
+    quad(FLOAT2(a.x + n.x, a.y + n.y), FLOAT2(b.x + n.x, b.y + n.y), FLOAT2(b.x - n.x, b.y - n.y), FLOAT2(a.x - n.x, a.y - n.y), col);
+}
+
+static void tessellate_ring(float2 center, float outer, float inner, float3 col, quad_func quad)
+{
+    float2 scale = pixels_per_unit();
+    int n_segments = 8 + (int)(outer * 0.5f);
+    if (n_segments > 64) n_segments = 64;
+
+    float2 prev_outer = FLOAT2(center.x + outer / scale.x, center.y);
+    float2 prev_inner = FLOAT2(center.x + inner / scale.x, center.y);
+    for (int i = 1; i <= n_segments; i++)
+    {
+        float angle = 2.f * PI * i / n_segments;
+        float2 dir = FLOAT2(cosf(angle) / scale.x, sinf(angle) / scale.y);
+        float2 next_outer = FLOAT2(center.x + dir.x * outer, center.y + dir.y * outer);
+        float2 next_inner = FLOAT2(center.x + dir.x * inner, center.y + dir.y * inner);
+        // Degenerates to a triangle for inner == 0
+        quad(prev_outer, next_outer, next_inner, prev_inner, col);
+        prev_outer = next_outer;
+        prev_inner = next_inner;
+    }
+}
+
+static void push_shape(shape_kind kind, float2 p0, float2 p1, float2 p2, float2 params, float3 col)
+{
+    if (g_backend == RENDER_BACKEND_SOFTWARE)
+    {
+        // Same distance functions in the rasterizer, the kinds match SW_SHAPE_*
+        sw_push_shape(kind, p0, p1, p2, FLOAT2(params.x * dpi_scale(), params.y * dpi_scale()), col);
+        return;
+    }
+    begin_batch(BATCH_SHAPES);
+    g_render_shapes.instances = grow_array(g_render_shapes.instances, &g_render_shapes.instance_capacity,
+                                           g_render_shapes.n_instances + 1, sizeof(shape_instance));
+    g_render_shapes.instances_uploaded = false;
+    shape_instance *shape = &g_render_shapes.instances[g_render_shapes.n_instances++];
+    shape->p0 = p0;
+    shape->p1 = p1;
+    shape->p2 = p2;
+    // Widths and radii are in window pixels, the shader measures distances in drawable pixels
+    shape->params = FLOAT2(params.x * dpi_scale(), params.y * dpi_scale());
+    shape->col = col;
+    shape->kind = kind;
+}
+
+void draw_triangle(float2 a, float2 b, float2 c, float3 col)
+{
+    if (capture_file_is_open()) capture_triangle(shape_capture_buffer(), a, b, c, col);
+    if (shapes_tessellated())
+    {
+        // Same split as draw_quad, the second triangle is empty
+        push_tessellated_quad(a, b, c, c, col);
+        return;
+    }
+    push_shape(SHAPE_TRIANGLE, a, b, c, FLOAT2(0.f, 0.f), col);
+}
+
+void draw_line(float2 a, float2 b, float thickness, float3 col)
+{
+    if (capture_file_is_open()) capture_line(shape_capture_buffer(), a, b, thickness, col);
+    if (shapes_tessellated())
+    {
+        tessellate_line(a, b, thickness, col, push_tessellated_quad);
+        return;
+    }
+    push_shape(SHAPE_LINE, a, b, b, FLOAT2(thickness, 0.f), col);
+}
+
+void draw_polyline(const float2 *points, u32 n_points, float thickness, float3 col)
+{
+    if (n_points < 2) return;
+
+    if (capture_file_is_open()) capture_polyline(shape_capture_buffer(), points, n_points, thickness, col);
+    if (shapes_tessellated())
+    {
+        for (u32 i = 0; i + 1 < n_points; i++)
+        {
+            tessellate_line(points[i], points[i + 1], thickness, col, push_tessellated_quad);
+        }
+        return;
+    }
+
+    if (g_backend == RENDER_BACKEND_SOFTWARE)
+    {
+        for (u32 i = 0; i + 1 < n_points; i++)
+        {
+            push_shape(SHAPE_LINE, points[i], points[i + 1], points[i + 1], FLOAT2(thickness, 0.f), col);
+        }
+        return;
+    }
+
+    begin_batch(BATCH_POLYLINES);
+    g_render_shapes.points = grow_array(g_render_shapes.points, &g_render_shapes.point_capacity,
+                                        g_render_shapes.n_points + n_points, sizeof(float2));
+    g_render_shapes.points_uploaded = false;
+    memcpy(g_render_shapes.points + g_render_shapes.n_points, points, n_points * sizeof(float2));
+
+    g_render_shapes.polylines = grow_array(g_render_shapes.polylines, &g_render_shapes.polyline_capacity,
+                                           g_render_shapes.n_polylines + 1, sizeof(polyline_batch));
+    polyline_batch *batch = &g_render_shapes.polylines[g_render_shapes.n_polylines++];
+    batch->first_point = g_render_shapes.n_points;
+    batch->n_points = n_points;
+    batch->thickness = thickness;
+    batch->col = col;
+
+    g_render_shapes.n_points += n_points;
+}
+
+static void push_ring(float2 center, float radius, float inner, float3 col)
+{
+    if (shapes_tessellated())
+    {
+        tessellate_ring(center, radius, inner, col, push_tessellated_quad);
+        return;
+    }
+    push_shape(SHAPE_RING, center, center, center, FLOAT2(radius, inner), col);
+}
+
+void draw_circle(float2 center, float radius, float3 col)
+{
+    if (capture_file_is_open()) capture_circle(shape_capture_buffer(), center, radius, col);
+    push_ring(center, radius, 0.f, col);
+}
+
+void draw_ring(float2 center, float radius, float thickness, float3 col)
+{
+    if (capture_file_is_open()) capture_ring(shape_capture_buffer(), center, radius, thickness, col);
+    float inner = radius - thickness;
+    if (inner < 0.f) inner = 0.f;
+    push_ring(center, radius, inner, col);
+}
+
+static void render_shapes(const frame_mark *from, const frame_mark *to)
+{
+    float2 half_size = FLOAT2(0.5f * g_drawable_size.x, 0.5f * g_drawable_size.y);
+
+    if (to->shape_instances > from->shape_instances)
+    {
+        // Orphaned every frame, the driver hands out fresh storage instead of waiting on the last draw
+        if (!g_render_shapes.instances_uploaded)
+        {
+            GL_CALL(glNamedBufferData(g_render_shapes.instance_buffer, g_render_shapes.n_instances * sizeof(shape_instance),
+                                      g_render_shapes.instances, GL_STREAM_DRAW));
+            g_render_shapes.instances_uploaded = true;
+        }
+        GL_CALL(glBindVertexArray(g_render_shapes.vao));
+        GL_CALL(glUseProgram(g_render_shapes.shader));
+        GL_CALL(glUniform2f(g_render_shapes.loc_half_size, half_size.x, half_size.y));
+        GL_CALL(glDrawArraysInstancedBaseInstance(GL_TRIANGLE_STRIP, 0, 4, to->shape_instances - from->shape_instances, from->shape_instances));
+    }
+
+    if (to->polylines > from->polylines)
+    {
+        if (!g_render_shapes.points_uploaded)
+        {
+            GL_CALL(glNamedBufferData(g_render_shapes.point_buffer, g_render_shapes.n_points * sizeof(float2),
+                                      g_render_shapes.points, GL_STREAM_DRAW));
+            g_render_shapes.points_uploaded = true;
+        }
+        GL_CALL(glBindVertexArray(g_render_shapes.polyline_vao));
+        GL_CALL(glUseProgram(g_render_shapes.polyline_shader));
+        GL_CALL(glUniform2f(g_render_shapes.loc_polyline_half_size, half_size.x, half_size.y));
+        for (u32 i = from->polylines; i < to->polylines; i++)
+        {
+            const polyline_batch *batch = &g_render_shapes.polylines[i];
+            GL_CALL(glUniform1f(g_render_shapes.loc_polyline_thickness, batch->thickness * dpi_scale()));
+            GL_CALL(glUniform3f(g_render_shapes.loc_polyline_col, batch->col.x, batch->col.y, batch->col.z));
+            // Base instance selects the first point, n - 1 segments
+            GL_CALL(glDrawArraysInstancedBaseInstance(GL_TRIANGLE_STRIP, 0, 4, batch->n_points - 1, batch->first_point));
+        }
+    }
+}
+
+// =====================================================
+// =============== RENDER CACHES
+// =====================================================
+
+render_cache *render_cache_create(float2 top_left, float2 size)
+{
+    render_cache *cache = calloc(1, sizeof(render_cache));
+    cache->top_left = top_left;
+    cache->size = size;
+
+    g_render_caches.caches = grow_array(g_render_caches.caches, &g_render_caches.cache_capacity,
+                                        g_render_caches.n_caches + 1, sizeof(render_cache *));
+    g_render_caches.caches[g_render_caches.n_caches++] = cache;
+    return cache;
+}
+
+static void release_cache_texture(render_cache *cache)
+{
+    if (cache->texture == 0) return;
+
+    glDeleteFramebuffers(1, &cache->framebuffer);
+    glDeleteTextures(1, &cache->texture);
+    g_render_caches.memory_used -= (size_t)cache->pixel_size.x * cache->pixel_size.y * sizeof(rgba);
+    cache->texture = 0;
+    cache->framebuffer = 0;
+    cache->valid = false;
+}
+
+void render_cache_destroy(render_cache *cache)
+{
+    if (g_render_caches.recording == cache)
+    {
+        printf("render_cache_destroy: cache is still recording\n");
+        abort();
+    }
+    release_cache_texture(cache);
+
+    for (u32 i = 0; i < g_render_caches.n_caches; i++)
+    {
+        if (g_render_caches.caches[i] == cache)
+        {
+            g_render_caches.caches[i] = g_render_caches.caches[--g_render_caches.n_caches];
+            break;
+        }
+    }
+    free(cache);
+}
+
+void render_cache_invalidate(render_cache *cache)
+{
+    cache->valid = false;
+    cache->animated = false;
+}
+
+void render_cache_set_memory_budget(size_t bytes)
+{
+    g_render_caches.memory_budget = bytes;
+}
+
+size_t render_cache_memory_used()
+{
+    return g_render_caches.memory_used;
+}
+
+// Drawn this frame but not rendered yet, its texture has to survive until then
+static bool cache_draw_pending(const render_cache *cache)
+{
+    for (u32 i = g_rendered.cache_draws; i < g_render_caches.n_draws; i++)
+    {
+        if (g_render_caches.draws[i] == cache) return true;
+    }
+    return false;
+}
+
+// Frees least recently drawn textures until 'needed' more bytes fit, false if they never will
+static bool make_cache_room(const render_cache *keep, size_t needed)
+{
+    if (g_render_caches.memory_budget == 0) return true;
+    if (needed > g_render_caches.memory_budget) return false;
+
+    while (g_render_caches.memory_used + needed > g_render_caches.memory_budget)
+    {
+        render_cache *oldest = NULL;
+        for (u32 i = 0; i < g_render_caches.n_caches; i++)
+        {
+            render_cache *cache = g_render_caches.caches[i];
+            if (cache == keep || cache->texture == 0 || cache_draw_pending(cache)) continue;
+            if (oldest == NULL || cache->last_used < oldest->last_used) oldest = cache;
+        }
+        if (oldest == NULL) return false;
+        release_cache_texture(oldest);
+    }
+    return true;
+}
+
+// Drawable pixels covered by the cache, snapped outwards so the texture maps 1:1 onto the screen
+static void update_cache_pixels(render_cache *cache, int2 *pixel_min, int2 *pixel_size)
+{
+    float2 a = to_ndc(cache->top_left);
+    float2 b = to_ndc(FLOAT2(cache->top_left.x + cache->size.x, cache->top_left.y - cache->size.y * y_up()));
+    float x0 = (fminf(a.x, b.x) + 1.f) * 0.5f * g_drawable_size.x;
+    float x1 = (fmaxf(a.x, b.x) + 1.f) * 0.5f * g_drawable_size.x;
+    float y0 = (fminf(a.y, b.y) + 1.f) * 0.5f * g_drawable_size.y;
+    float y1 = (fmaxf(a.y, b.y) + 1.f) * 0.5f * g_drawable_size.y;
+
+    int ix0 = (int)floorf(x0), iy0 = (int)floorf(y0);
+    int ix1 = (int)ceilf(x1), iy1 = (int)ceilf(y1);
+    if (ix0 < 0) ix0 = 0;
+    if (iy0 < 0) iy0 = 0;
+    if (ix1 > g_drawable_size.x) ix1 = g_drawable_size.x;
+    if (iy1 > g_drawable_size.y) iy1 = g_drawable_size.y;
+
+    *pixel_min = INT2(ix0, iy0);
+    *pixel_size = INT2(ix1 > ix0 ? ix1 - ix0 : 0, iy1 > iy0 ? iy1 - iy0 : 0);
+}
+
+bool render_cache_begin(render_cache *cache, uint64_t content_hash)
+{
+    if (g_render_caches.recording != NULL)
+    {
+        printf("render_cache_begin: caches can't be nested\n");
+        abort();
+    }
+
+    // Without a GL context on this thread, or while capturing, the group is drawn every frame.
+    // So are groups with particles, a cached texture would freeze them.
+    cache->passthrough = g_backend != RENDER_BACKEND_GL || g_record_packet != NULL || capture_file_is_open()
+        || (cache->animated && cache->content_hash == content_hash);
+    if (cache->passthrough)
+    {
+        release_cache_texture(cache);
+        g_render_caches.recording = cache;
+        return true;
+    }
+
+    if (cache->window_size.x != g_window_size.x || cache->window_size.y != g_window_size.y
+        || cache->drawable_size.x != g_drawable_size.x || cache->drawable_size.y != g_drawable_size.y
+        || cache->coords != g_coords)
+    {
+        release_cache_texture(cache);
+    }
+    if (cache->valid && cache->content_hash == content_hash) return false;
+
+    int2 pixel_min, pixel_size;
+    update_cache_pixels(cache, &pixel_min, &pixel_size);
+    if (cache->texture != 0 && (pixel_size.x != cache->pixel_size.x || pixel_size.y != cache->pixel_size.y))
+    {
+        release_cache_texture(cache);
+    }
+
+    if (cache->texture == 0)
+    {
+        size_t bytes = (size_t)pixel_size.x * pixel_size.y * sizeof(rgba);
+        if (bytes == 0 || !make_cache_room(cache, bytes))
+        {
+            // Doesn't fit the budget, draw directly instead
+            cache->passthrough = true;
+            g_render_caches.recording = cache;
+            return true;
+        }
+
+        GL_CALL(glCreateTextures(GL_TEXTURE_2D, 1, &cache->texture));
+        GL_CALL(glTextureStorage2D(cache->texture, 1, GL_RGBA8, pixel_size.x, pixel_size.y));
+        GL_CALL(glTextureParameteri(cache->texture, GL_TEXTURE_MIN_FILTER, GL_NEAREST));
+        GL_CALL(glTextureParameteri(cache->texture, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
+        gl_label(GL_TEXTURE, cache->texture, "render cache");
+
+        GL_CALL(glCreateFramebuffers(1, &cache->framebuffer));
+        GL_CALL(glNamedFramebufferTexture(cache->framebuffer, GL_COLOR_ATTACHMENT0, cache->texture, 0));
+        GLenum status = GL_CALL(glCheckNamedFramebufferStatus(cache->framebuffer, GL_FRAMEBUFFER));
+        if (status != GL_FRAMEBUFFER_COMPLETE)
+        {
+            printf("Render cache framebuffer incomplete: 0x%x\n", status);
+            abort();
+        }
+        g_render_caches.memory_used += bytes;
+    }
+
+    cache->pixel_min = pixel_min;
+    cache->pixel_size = pixel_size;
+    cache->window_size = g_window_size;
+    cache->drawable_size = g_drawable_size;
+    cache->coords = g_coords;
+    cache->content_hash = content_hash;
+    g_render_caches.recording = cache;
+    g_render_caches.recording_start = current_frame_mark();
+    g_render_caches.recording_batches = g_batches.n_batches;
+    return true;
+}
+
+void render_cache_end(render_cache *cache)
+{
+    if (g_render_caches.recording != cache)
+    {
+        printf("render_cache_end: cache was not started with render_cache_begin\n");
+        abort();
+    }
+    g_render_caches.recording = NULL;
+    if (cache->passthrough) return;
+
+    // Particles step every frame, leave the group in the frame and draw it directly from now on
+    frame_mark recording_end = current_frame_mark();
+    if (recording_end.particle_draws > g_render_caches.recording_start.particle_draws)
+    {
+        release_cache_texture(cache);
+        cache->animated = true;
+        return;
+    }
+
+    // The viewport keeps covering the whole drawable, shifted so the cached pixels land at the
+    // texture origin. The recorded draws then rasterize exactly as they would on screen.
+    GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, cache->framebuffer));
+    GL_CALL(glViewport(-cache->pixel_min.x, -cache->pixel_min.y, g_drawable_size.x, g_drawable_size.y));
+    GL_CALL(glClearColor(0.0f, 0.0f, 0.0f, 0.0f));
+    GL_CALL(glClear(GL_COLOR_BUFFER_BIT));
+    // Premultiplied result, so alpha accumulates coverage instead of being blended like a color
+    GL_CALL(glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA));
+
+    // The batch the recording started in may have been continued by it
+    u32 first_batch = g_render_caches.recording_batches > 0 ? g_render_caches.recording_batches - 1 : 0;
+    g_render_caches.rendering_recording = true;
+    render_batches(first_batch, &g_render_caches.recording_start, &recording_end);
+    g_render_caches.rendering_recording = false;
+
+    GL_CALL(glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA));
+    GL_CALL(glViewport(0, 0, g_drawable_size.x, g_drawable_size.y));
+    GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+
+    // Take the recorded geometry back out of the frame, it lives in the texture now
+    const frame_mark *start = &g_render_caches.recording_start;
+    g_render_tilemaps.n_draws = start->tilemap_draws;
+    g_render_triangles.n_vertices = start->triangle_vertices;
+    g_render_triangles.n_indices = start->triangle_indices;
+    g_render_shapes.n_instances = start->shape_instances;
+    g_render_shapes.n_polylines = start->polylines;
+    g_render_shapes.n_points = start->polyline_points;
+    g_render_particles.n_draws = start->particle_draws;
+    g_render_particles.n_instances = start->particle_instances;
+    g_render_text.n_vertices = start->text_vertices;
+    g_render_text.n_indices = start->text_indices;
+    g_render_caches.n_draws = start->cache_draws;
+    g_batches.n_batches = g_render_caches.recording_batches;
+
+    cache->valid = true;
+}
+
+void draw_render_cache(render_cache *cache)
+{
+    if (cache->passthrough || !cache->valid || cache->texture == 0) return;
+
+    cache->last_used = ++g_render_caches.clock;
+    if (g_render_caches.n_draws == MAX_CACHE_DRAWS)
+    {
+        printf("Too many render cache draws, increase MAX_CACHE_DRAWS\n");
+        abort();
+    }
+    begin_batch(BATCH_CACHES);
+    g_render_caches.draws[g_render_caches.n_draws++] = cache;
+}
+
+static void render_cache_draws(u32 first_draw, u32 end_draw)
+{
+    if (end_draw <= first_draw) return;
+
+    GL_CALL(glBindVertexArray(g_render_caches.vao));
+    GL_CALL(glUseProgram(g_render_caches.shader));
+    GL_CALL(glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA));
+    for (u32 i = first_draw; i < end_draw; i++)
+    {
+        const render_cache *cache = g_render_caches.draws[i];
+        // Unit 3, the cache may have been released since draw_render_cache
+        if (cache->texture == 0) continue;
+        GL_CALL(glBindTextureUnit(3, cache->texture));
+        float x0 = 2.f * cache->pixel_min.x / g_drawable_size.x - 1.f;
+        float y0 = 2.f * cache->pixel_min.y / g_drawable_size.y - 1.f;
+        float x1 = 2.f * (cache->pixel_min.x + cache->pixel_size.x) / g_drawable_size.x - 1.f;
+        float y1 = 2.f * (cache->pixel_min.y + cache->pixel_size.y) / g_drawable_size.y - 1.f;
+        GL_CALL(glUniform4f(g_render_caches.loc_rect, x0, y0, x1, y1));
+        GL_CALL(glDrawArrays(GL_TRIANGLE_STRIP, 0, 4));
+    }
+    if (g_render_caches.rendering_recording)
+    {
+        GL_CALL(glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA));
+    }
+    else
+    {
+        GL_CALL(glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA));
+    }
+}
+
+// =====================================================
+// =============== PIPELINED RENDERING
+// =====================================================
+
+static void update_timing(float *timing, Uint64 start, Uint64 end)
+{
+    float ms = 1000.f * (end - start) / (float)SDL_GetPerformanceFrequency();
+    if (g_timings_lock != NULL) SDL_LockMutex(g_timings_lock);
+    *timing += (ms - *timing) * TIMING_SMOOTHING;
+    if (g_timings_lock != NULL) SDL_UnlockMutex(g_timings_lock);
+}
+
+frame_timings get_frame_timings()
+{
+    if (g_timings_lock != NULL) SDL_LockMutex(g_timings_lock);
+    frame_timings timings = g_timings;
+    if (g_timings_lock != NULL) SDL_UnlockMutex(g_timings_lock);
+    return timings;
+}
+
+// Render thread side of the software hand-over, the buffer follows the framebuffer through resizes
+static void hand_over_sw_frame()
+{
+    int2 size = g_view_drawable_size;
+    SDL_LockMutex(g_sw_present_lock);
+    if (g_sw_present_surface == NULL || g_sw_present_surface->w != size.x || g_sw_present_surface->h != size.y)
+    {
+        SDL_FreeSurface(g_sw_present_surface);
+        free(g_sw_present_pixels);
+        g_sw_present_pixels = malloc((size_t)size.x * size.y * sizeof(rgba));
+        g_sw_present_surface = SDL_CreateRGBSurfaceWithFormatFrom(g_sw_present_pixels, size.x, size.y, 32,
+                                                                  size.x * sizeof(rgba), SDL_PIXELFORMAT_RGBA32);
+    }
+    memcpy(g_sw_present_pixels, sw_framebuffer(), (size_t)size.x * size.y * sizeof(rgba));
+    g_sw_present_pending = true;
+    SDL_UnlockMutex(g_sw_present_lock);
+}
+
+static int render_thread_main(void *arg)
+{
+    UNUSED(arg);
+
+    if (g_backend == RENDER_BACKEND_GL)
+    {
+        SDL_GL_MakeCurrent(g_window, g_glcontext);
+    }
+
+    for (int index = 0; ; index = (index + 1) % N_FRAME_PACKETS)
+    {
+        SDL_SemWait(g_ready_packets);
+        frame_packet *packet = &g_packets[index];
+        if (packet->quit) break;
+
+        if (packet->window_size.x != g_view_window_size.x || packet->window_size.y != g_view_window_size.y
+            || packet->drawable_size.x != g_view_drawable_size.x || packet->drawable_size.y != g_view_drawable_size.y)
+        {
+            apply_view(packet->window_size, packet->drawable_size, g_view_coords);
+        }
+
+        Uint64 render_start = SDL_GetPerformanceCounter();
+        if (packet->clear)
+        {
+            clear_frame(packet->clear_color);
+        }
+        upload_draw_list(packet->list, packet);
+        do_render();
+        Uint64 render_end = SDL_GetPerformanceCounter();
+        if (g_backend == RENDER_BACKEND_SOFTWARE)
+        {
+            hand_over_sw_frame();
+        }
+        else
+        {
+            present();
+        }
+        Uint64 present_end = SDL_GetPerformanceCounter();
+
+        update_timing(&g_timings.render_ms, render_start, render_end);
+        update_timing(&g_timings.present_ms, render_end, present_end);
+
+        SDL_SemPost(g_free_packets);
+    }
+
+    if (g_backend == RENDER_BACKEND_GL)
+    {
+        SDL_GL_MakeCurrent(g_window, NULL);
+    }
+    return 0;
+}
+
+// Main thread side of the software hand-over, shows the newest finished frame if there is one
+static void present_sw_frame()
+{
+    SDL_LockMutex(g_sw_present_lock);
+    if (g_sw_present_pending)
+    {
+        SDL_BlitSurface(g_sw_present_surface, NULL, SDL_GetWindowSurface(g_window), NULL);
+        SDL_UpdateWindowSurface(g_window);
+        g_sw_present_pending = false;
+    }
+    SDL_UnlockMutex(g_sw_present_lock);
+}
+
+void main_loop_pipelined(tick_func tick)
+{
+    for (int i = 0; i < N_FRAME_PACKETS; i++)
+    {
+        g_packets[i].list = draw_list_create();
+        g_packets[i].clear = false;
+        g_packets[i].n_particle_draws = 0;
+        g_packets[i].n_particle_instances = 0;
+        g_packets[i].quit = false;
+    }
+    g_pipelined = true;
+    g_free_packets = SDL_CreateSemaphore(N_FRAME_PACKETS);
+    g_ready_packets = SDL_CreateSemaphore(0);
+    g_timings_lock = SDL_CreateMutex();
+
+    // The context can only be current on one thread at a time
+    if (g_backend == RENDER_BACKEND_GL)
+    {
+        SDL_GL_MakeCurrent(g_window, NULL);
+    }
+    else
+    {
+        // The hand-over buffer is allocated with the first frame
+        g_sw_present_lock = SDL_CreateMutex();
+        g_sw_present_pending = false;
+    }
+    SDL_Thread *render_thread = SDL_CreateThread(render_thread_main, "render", NULL);
+    if (render_thread == NULL)
+    {
+        printf("Failed to create render thread: %s\n", SDL_GetError());
+        abort();
+    }
+
+    bool doRun = true;
+    Uint64 prev_tick_end = 0;
+    int index = 0;
+    while (doRun)
+    {
+        // React to new events
+        SDL_Event windowEvent;
+        while (SDL_PollEvent(&windowEvent))
+        {
+            if (windowEvent.type == SDL_QUIT) doRun = false;
+            handle_window_event(&windowEvent);
+        }
+
+        if (g_backend == RENDER_BACKEND_SOFTWARE)
+        {
+            present_sw_frame();
+        }
+
+        // Blocks only if the render thread is a full packet behind
+        Uint64 wait_start = SDL_GetPerformanceCounter();
+        SDL_SemWait(g_free_packets);
+        frame_packet *packet = &g_packets[index];
+        index = (index + 1) % N_FRAME_PACKETS;
+
+        Uint64 tick_start = SDL_GetPerformanceCounter();
+        packet->clear = false;
+        packet->n_particle_draws = 0;
+        packet->n_particle_instances = 0;
+        draw_list_reset(packet->list);
+        g_record_packet = packet;
+        if (prev_tick_end != 0) {
+            float delta = (tick_start - prev_tick_end) / (float)SDL_GetPerformanceFrequency();
+            tick(delta);
+
+            // The packet holds this frame's calls in order, a clear always comes first
+            if (capture_file_is_open()) {
+                if (packet->clear) capture_clear(&g_capture, packet->clear_color);
+                capture_buffer_append(&g_capture, &packet->list->ops);
+            }
+            end_capture_frame(delta);
+        }
+        g_record_packet = NULL;
+        packet->window_size = g_window_size;
+        packet->drawable_size = g_drawable_size;
+        prev_tick_end = SDL_GetPerformanceCounter();
+
+        SDL_SemPost(g_ready_packets);
+
+        update_timing(&g_timings.wait_ms, wait_start, tick_start);
+        update_timing(&g_timings.tick_ms, tick_start, prev_tick_end);
+
+        if (g_settings.max_fps > 0) {
+            float ms_per_frame = 1000.f / g_settings.max_fps;
+            float ms_per_frame_actual = 1000.f * (SDL_GetPerformanceCounter() - wait_start) / (float)SDL_GetPerformanceFrequency();
+            if (ms_per_frame_actual < ms_per_frame) {
+                SDL_Delay((u32)(ms_per_frame - ms_per_frame_actual));
+            }
+        }
+    }
+
+    // Packets are consumed in order, so the quit packet is seen after all pending frames
+    SDL_SemWait(g_free_packets);
+    g_packets[index].quit = true;
+    SDL_SemPost(g_ready_packets);
+    SDL_WaitThread(render_thread, NULL);
+
+    g_pipelined = false;
+    if (g_backend == RENDER_BACKEND_GL)
+    {
+        SDL_GL_MakeCurrent(g_window, g_glcontext);
+    }
+    // Catch up on a resize or mode change the render thread didn't see anymore
+    apply_view(g_window_size, g_drawable_size, g_coords);
+    if (g_backend == RENDER_BACKEND_SOFTWARE)
+    {
+        update_sw_surface();
+        present_sw_frame();
+        SDL_FreeSurface(g_sw_present_surface);
+        free(g_sw_present_pixels);
+        SDL_DestroyMutex(g_sw_present_lock);
+        g_sw_present_surface = NULL;
+        g_sw_present_pixels = NULL;
+        g_sw_present_lock = NULL;
+    }
+
+    SDL_DestroyMutex(g_timings_lock);
+    g_timings_lock = NULL;
+    SDL_DestroySemaphore(g_free_packets);
+    SDL_DestroySemaphore(g_ready_packets);
+    for (int i = 0; i < N_FRAME_PACKETS; i++)
+    {
+        draw_list_destroy(g_packets[i].list);
+        g_packets[i].list = NULL;
+        free(g_packets[i].particle_instances);
+        g_packets[i].particle_instances = NULL;
+        g_packets[i].particle_instance_capacity = 0;
+    }
+}
+
+// =====================================================
+// =============== CAPTURE
+// =====================================================
+
+static void end_capture_frame(float dt)
+{
+    if (!capture_file_is_open()) return;
+    capture_frame(&g_capture, dt);
+    capture_file_write(&g_capture);
+}
+
+void start_capture(const char *path)
+{
+    capture_buffer_reset(&g_capture);
+    if (capture_file_open(path, g_window_size))
+    {
+        capture_coords(&g_capture, g_coords);
+    }
+}
+
+void stop_capture()
+{
+    capture_file_close();
+    capture_buffer_free(&g_capture);
+}
+
+void render_frame()
+{
+    do_render();
+    present();
+}
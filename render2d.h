@@ -2,19 +2,91 @@
 #define RENDER2D_H
 
 #include "linalg.h"
+#include <stdbool.h>
+#include <stddef.h>
 
 typedef void (*tick_func)(float dt);
 
+typedef enum {
+    RENDER_BACKEND_GL,
+    RENDER_BACKEND_SOFTWARE, // CPU rasterizer, no GPU or GL driver required
+} render_backend;
+
 void load_font(const char *bitmap_file);
 void make_window(int2 top_left, int2 size, const char* title);
+void make_window_with_backend(int2 top_left, int2 size, const char* title, render_backend backend);
 void teardown_window();
 
+// Renders everything drawn since the last clear_screen and copies the result
+// into 'pixels' (get_drawable_size() pixels, top row first)
+void read_framebuffer(rgba *pixels);
+
 void main_loop(tick_func tick);
+// Like main_loop, but the GL context moves to a dedicated render thread that runs one frame
+// behind: while the render thread submits and presents frame N-1, tick records frame N.
+// draw_* calls made from tick are recorded into a frame packet instead of touching GL.
+// With the software backend the render thread rasterizes and the main thread presents.
+void main_loop_pipelined(tick_func tick);
+
+// Per stage timings in ms, smoothed over the last frames
+typedef struct {
+    float tick_ms;    // simulation, main thread
+    float wait_ms;    // main thread blocked on the render thread (pipelined only)
+    float render_ms;  // geometry upload + draw calls
+    float present_ms; // swap / present
+} frame_timings;
+
+frame_timings get_frame_timings();
+
+// Renders and presents everything drawn since the last clear_screen,
+// for callers that drive their own loop instead of main_loop (e.g. replay)
+void render_frame();
+
+// Records every clear_screen / draw_* call with frame boundaries into a binary capture,
+// see capture.h. Also started by make_window if RENDER2D_CAPTURE=<file> is set.
+void start_capture(const char *path);
+void stop_capture();
 
+// Coordinates of all positions and sizes passed to draw_*. COORDS_NDC (the default) spans -1..1
+// with y up. COORDS_PIXELS is in window pixels with the origin at the top left and y down, so
+// draw_rect's top_left is the visually top left corner in both modes; text pos is the baseline
+// start in both. Both backends project draws when they are rendered and follow window resizes. On
+// high-DPI displays the drawable is larger than the window: positions stay in window pixels, glyphs
+// are snapped to the drawable's pixel grid and widths/radii of shapes scale with it.
+// Every draw keeps the mode it was made in, so the mode can change anywhere in a frame, e.g. a
+// pixel HUD over an NDC scene, and geometry kept from earlier frames stays in its own mode.
+typedef enum {
+    COORDS_NDC,
+    COORDS_PIXELS,
+} coord_mode;
+
+void set_coord_mode(coord_mode coords);
+coord_mode get_coord_mode();
+int2 get_window_size();
+// Draws follow the new size from the next frame on, the software backend reallocates its
+// framebuffer to it and draws geometry kept from earlier frames again at the new size
+void set_window_size(int2 size);
+// Framebuffer size in pixels, e.g. twice the window size on a high-DPI display
+int2 get_drawable_size();
+
+// Draws are layered in call order on both backends and inside main_loop_pipelined: each one
+// covers what was drawn before it in the frame, whatever the kinds of the two.
 void clear_screen(float3 col);
 void draw_rect(float2 top_left, float2 size, float3 col);
 void draw_quad(float2 a, float2 b, float2 c, float2 d, float3 col);
+
+// Analytic shapes, each one instance whose edges are anti-aliased in the fragment shader from
+// a signed distance. Positions follow the coord mode like everything else, widths and radii are
+// always in window pixels so circles stay round on non-square windows.
+// A polyline is one instanced draw with a single point per segment, e.g. a 100k point chart.
+// The software backend shades them with the same distance functions, inside main_loop_pipelined
+// shapes are tessellated into quads.
 void draw_triangle(float2 a, float2 b, float2 c, float3 col);
+void draw_line(float2 a, float2 b, float thickness, float3 col);
+void draw_polyline(const float2 *points, u32 n_points, float thickness, float3 col);
+void draw_circle(float2 center, float radius, float3 col);
+// Outer radius 'radius', inner radius 'radius - thickness'
+void draw_ring(float2 center, float radius, float thickness, float3 col);
 
 void draw_text(float2 pos, float size, float3 col, const char* text);
 void draw_textf_i(float2 pos, float size, float3 col, const char* fmt, ...);
@@ -23,4 +95,99 @@ void draw_textf_i(float2 pos, float size, float3 col, const char* fmt, ...);
     (void)(sizeof(printf(__VA_ARGS__))); \
     draw_textf_i(pos, size, col, __VA_ARGS__)
 
+// Grid of cells colored by a small integer state, e.g. a game board or a heatmap.
+// Cell states live in an integer texture on the GPU; only cells changed since the last draw
+// are uploaded, and the whole grid is one quad, so the cost doesn't depend on the cell count.
+// With the software backend or inside main_loop_pipelined they fall back to one quad per cell.
+// Every backend draws the cells as they are at the draw_tilemap call, later changes show up
+// with the next draw.
+typedef struct tilemap tilemap;
+
+// palette: color per state, n_colors <= 256, states >= n_colors draw with the last color
+tilemap *tilemap_create(int2 cells, const float3 *palette, int n_colors);
+void tilemap_destroy(tilemap *map);
+void tilemap_set(tilemap *map, int2 cell, unsigned char state);
+unsigned char tilemap_get(const tilemap *map, int2 cell);
+// Copies a full cells.x * cells.y array (row 0 at the top), only differing cells are marked changed
+void tilemap_update(tilemap *map, const unsigned char *states);
+void draw_tilemap(tilemap *map, float2 top_left, float2 size);
+
+// Particles live in a GPU buffer: a compute shader spawns and simulates them and one
+// instanced draw renders them, so there is no per-frame upload apart from a few uniforms.
+// Without compute shaders or storage buffers in the vertex stage the same simulation runs
+// on the CPU and the live particles are streamed into one instanced draw per frame, the
+// software backend draws them as quads. Particles are not captured.
+// RENDER2D_PARTICLES=cpu forces the CPU path.
+typedef struct particle_system particle_system;
+
+typedef struct {
+    float2 position;
+    float2 position_spread; // random offset in [-spread, spread] per axis
+    float2 velocity;        // per second
+    float2 velocity_spread;
+    float lifetime;         // seconds
+    float lifetime_spread;
+    float size;             // width of the particle
+    float3 color_start;
+    float3 color_end;       // reached at the end of the lifetime, the particle fades out on the GPU path
+} particle_emit_params;
+
+typedef struct {
+    float2 gravity; // acceleration per second
+    float drag;     // fraction of the velocity lost per second
+} particle_update_params;
+
+// Create and destroy outside of main_loop_pipelined's tick, they touch the GL context
+particle_system *particles_create(u32 max_particles);
+void particles_destroy(particle_system *ps);
+void particles_set_update(particle_system *ps, const particle_update_params *params);
+// Spawns count particles on the next draw_particles, reusing the oldest slots when full
+void particles_emit(particle_system *ps, const particle_emit_params *params, u32 count);
+// Advances the simulation by dt and draws all live particles
+void draw_particles(particle_system *ps, float dt);
+
+// Renders a group of draw calls into an offscreen texture once and shows it as one textured
+// quad on later frames, for static content like legends or panels built from many glyphs.
+//     if (render_cache_begin(cache, hash)) { ...draw_* calls...; render_cache_end(cache); }
+//     draw_render_cache(cache);
+// begin returns false while the cached texture is still valid, it is redrawn after
+// render_cache_invalidate, when content_hash changes or when the window size or coord mode changes.
+// Cached content only covers the region given at creation and is layered at the
+// draw_render_cache call like any other draw.
+// Don't call clear_screen between begin and end.
+// With the software backend, inside main_loop_pipelined, while capturing or if the cache doesn't
+// fit the memory budget, begin always returns true and the calls are drawn directly. The same
+// goes for groups that draw particles, until they are invalidated or their hash changes.
+typedef struct render_cache render_cache;
+
+render_cache *render_cache_create(float2 top_left, float2 size);
+void render_cache_destroy(render_cache *cache);
+bool render_cache_begin(render_cache *cache, uint64_t content_hash);
+void render_cache_end(render_cache *cache);
+void render_cache_invalidate(render_cache *cache);
+void draw_render_cache(render_cache *cache);
+// Texture memory of all caches in bytes. Over budget the least recently drawn caches are
+// released and get redrawn on their next begin, 0 (the default) means unlimited.
+void render_cache_set_memory_budget(size_t bytes);
+size_t render_cache_memory_used();
+
+// Draw lists record geometry on the CPU without touching the GL context, so worker threads
+// can each fill their own list in parallel. submit_draw_list() appends a list to the current
+// frame on the render thread; submitting lists in a fixed order keeps the result deterministic.
+// A list is owned by one thread at a time and keeps its contents until draw_list_reset().
+// Draws are laid out in the coord mode and window size current at draw_list_create() or the
+// last draw_list_reset(), so those two are called on the main thread, recording threads only
+// touch their list.
+typedef struct draw_list draw_list;
+
+draw_list *draw_list_create();
+void draw_list_destroy(draw_list *list);
+void draw_list_reset(draw_list *list);
+
+void draw_rect_dl(draw_list *list, float2 top_left, float2 size, float3 col);
+void draw_quad_dl(draw_list *list, float2 a, float2 b, float2 c, float2 d, float3 col);
+void draw_text_dl(draw_list *list, float2 pos, float size, float3 col, const char* text);
+
+void submit_draw_list(const draw_list *list);
+
 #endif // RENDER2D_H
@@ -1,7 +1,14 @@
 #include "linalg.h"
 #include "gl_utils.h"
 #include "render2d.h"
+#include <SDL.h>
+#include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static particle_system *g_fountain;
+static int g_quit_after = 0; // frames, 0 runs until the window is closed
 
 void tick(float dt)
 {
@@ -23,6 +30,28 @@ void tick(float dt)
     float2 d = rotatef2(FLOAT2(-0.25f,  0.25f), angle);
     draw_quad(a, b, c, d, GREEN);
 
+    static float2 wave[200];
+    for (int i = 0; i < 200; i++) {
+        wave[i] = FLOAT2(-0.8f + 1.6f * i / 199.f, -0.5f + 0.1f * sinf(i * 0.1f + angle));
+    }
+    draw_polyline(wave, 200, 2.f, WHITE);
+    draw_ring(FLOAT2(0.6f, -0.6f), 40.f, 4.f, WHITE);
+    draw_circle(FLOAT2(0.6f, -0.6f), 10.f, RED);
+
+    particle_emit_params fountain = {
+        .position = FLOAT2(0.0f, -0.9f),
+        .position_spread = FLOAT2(0.02f, 0.0f),
+        .velocity = FLOAT2(0.0f, 1.2f),
+        .velocity_spread = FLOAT2(0.3f, 0.2f),
+        .lifetime = 2.0f,
+        .lifetime_spread = 0.5f,
+        .size = 0.01f,
+        .color_start = WHITE,
+        .color_end = BLUE,
+    };
+    particles_emit(g_fountain, &fountain, (u32)(dt * 5000.f) + 1);
+    draw_particles(g_fountain, dt);
+
     draw_text(bcastf2(-0.8f), 0.075f, WHITE, "Hello world!");
     // draw_text(FLOAT2(0, 0.8f), 0.075f, GREEN, "Meep Moop");
 
@@ -35,20 +64,49 @@ void tick(float dt)
     }
 
     draw_textf(FLOAT2(-0.8f, 0.8f), 0.075f, GREEN, "Started %ds ago", seconds);
+
+    frame_timings timings = get_frame_timings();
+    draw_textf(FLOAT2(-0.95f, -0.95f), 0.04f, WHITE, "tick %.2f wait %.2f render %.2f present %.2f ms",
+               timings.tick_ms, timings.wait_ms, timings.render_ms, timings.present_ms);
+
+    static int frames = 0;
+    if (g_quit_after > 0 && ++frames == g_quit_after) {
+        SDL_Event quit;
+        memset(&quit, 0, sizeof(quit));
+        quit.type = SDL_QUIT;
+        SDL_PushEvent(&quit);
+    }
 }
 
 int main(int argc, char *argv[])
 {
-    UNUSED(argc);
-    UNUSED(argv);
+    // renderTest [--software] [--pipelined] [--frames N] [font], --frames quits after N frames
+    render_backend backend = RENDER_BACKEND_GL;
+    bool pipelined = false;
+    const char *font = "../ExportedFont.png";
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--software") == 0) backend = RENDER_BACKEND_SOFTWARE;
+        else if (strcmp(argv[i], "--pipelined") == 0) pipelined = true;
+        else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) g_quit_after = atoi(argv[++i]);
+        else font = argv[i];
+    }
 
-    make_window(INT2(100, 100), INT2(800, 600), "2D Render Test");
-    load_font("../ExportedFont.png");
+    make_window_with_backend(INT2(100, 100), INT2(800, 600), "2D Render Test", backend);
+    load_font(font);
 
     printf("Hello 2D Render Test!\n");
 
-    main_loop(tick);
+    g_fountain = particles_create(20000);
+    particle_update_params forces = { .gravity = FLOAT2(0.0f, -1.0f), .drag = 0.1f };
+    particles_set_update(g_fountain, &forces);
+
+    if (pipelined) {
+        main_loop_pipelined(tick);
+    } else {
+        main_loop(tick);
+    }
 
+    particles_destroy(g_fountain);
     teardown_window();
 
     return 0;
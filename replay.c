@@ -0,0 +1,142 @@
+#include "linalg.h"
+#include "capture.h"
+#include "gl_utils.h"
+#include "render2d.h"
+#include <SDL.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Replays a capture recorded with RENDER2D_CAPTURE / start_capture and reports frame timings.
+// Usage: replay <capture> [--realtime] [--software] [--loops N] [--csv <file>]
+//   --realtime  keep the recorded frame pacing instead of rendering as fast as possible
+//   --csv       write one line per replayed frame
+
+static int compare_floats(const void *a, const void *b)
+{
+    float fa = *(const float *)a;
+    float fb = *(const float *)b;
+    return (fa > fb) - (fa < fb);
+}
+
+static void write_line(SDL_RWops *out, const char *fmt, ...)
+{
+    char line[128];
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+    if (n > 0) SDL_RWwrite(out, line, n < (int)sizeof(line) ? n : (int)sizeof(line) - 1, 1);
+}
+
+static bool poll_quit()
+{
+    SDL_Event windowEvent;
+    while (SDL_PollEvent(&windowEvent))
+    {
+        if (windowEvent.type == SDL_QUIT) return true;
+    }
+    return false;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *capture_path = NULL;
+    const char *csv_path = NULL;
+    bool realtime = false;
+    int loops = 1;
+    render_backend backend = RENDER_BACKEND_GL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--realtime") == 0) realtime = true;
+        else if (strcmp(argv[i], "--software") == 0) backend = RENDER_BACKEND_SOFTWARE;
+        else if (strcmp(argv[i], "--loops") == 0 && i + 1 < argc) loops = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--csv") == 0 && i + 1 < argc) csv_path = argv[++i];
+        else capture_path = argv[i];
+    }
+    if (capture_path == NULL || loops < 1) {
+        printf("Usage: %s <capture> [--realtime] [--software] [--loops N] [--csv <file>]\n", argv[0]);
+        return 1;
+    }
+
+    capture_reader reader;
+    if (!capture_reader_open(&reader, capture_path)) {
+        return 1;
+    }
+
+    make_window_with_backend(INT2(100, 100), reader.window_size, "Replay", backend);
+    load_font("../ExportedFont.png");
+
+    SDL_RWops *csv = NULL;
+    if (csv_path != NULL) {
+        csv = SDL_RWFromFile(csv_path, "w");
+        if (csv == NULL) printf("Could not open '%s': %s\n", csv_path, SDL_GetError());
+        else write_line(csv, "frame,recorded_dt_ms,replay_ms\n");
+    }
+
+    u32 n_frames = 0;
+    u32 frame_capacity = 1024;
+    float *frame_ms = malloc(frame_capacity * sizeof(float));
+
+    bool quit = false;
+    Uint64 replay_start = SDL_GetPerformanceCounter();
+    for (int loop = 0; loop < loops && !quit; loop++) {
+        capture_reader_rewind(&reader);
+        set_coord_mode(COORDS_NDC); // version 1 captures don't record the mode
+        Uint64 loop_start = SDL_GetPerformanceCounter();
+        Uint64 frame_start = loop_start;
+
+        capture_cmd cmd;
+        while (!quit && capture_reader_next(&reader, &cmd)) {
+            capture_reader_replay(&reader, &cmd);
+            if (cmd.op == CAPTURE_OP_FRAME) {
+                if (realtime) {
+                    // Wait until this frame was due in the original recording
+                    Uint64 due = loop_start + (Uint64)(cmd.time_us * 1e-6 * SDL_GetPerformanceFrequency());
+                    Uint64 now = SDL_GetPerformanceCounter();
+                    if (now < due) {
+                        SDL_Delay((u32)((due - now) * 1000 / SDL_GetPerformanceFrequency()));
+                    }
+                    frame_start = SDL_GetPerformanceCounter();
+                }
+
+                render_frame();
+                Uint64 frame_end = SDL_GetPerformanceCounter();
+                float ms = 1000.f * (frame_end - frame_start) / (float)SDL_GetPerformanceFrequency();
+
+                if (n_frames == frame_capacity) {
+                    frame_capacity *= 2;
+                    frame_ms = realloc(frame_ms, frame_capacity * sizeof(float));
+                }
+                frame_ms[n_frames] = ms;
+                if (csv != NULL) write_line(csv, "%u,%.3f,%.3f\n", n_frames, cmd.dt * 1000.f, ms);
+                n_frames++;
+
+                quit = poll_quit();
+                frame_start = SDL_GetPerformanceCounter();
+            }
+        }
+    }
+    float total_ms = 1000.f * (SDL_GetPerformanceCounter() - replay_start) / (float)SDL_GetPerformanceFrequency();
+
+    if (n_frames > 0) {
+        float sum = 0.f;
+        for (u32 i = 0; i < n_frames; i++) sum += frame_ms[i];
+        qsort(frame_ms, n_frames, sizeof(float), compare_floats);
+
+        printf("Replayed %u frames in %.2f ms (%s)\n", n_frames, total_ms, realtime ? "realtime" : "as fast as possible");
+        printf("frame ms: avg %.3f  min %.3f  p50 %.3f  p95 %.3f  p99 %.3f  max %.3f\n",
+               sum / n_frames, frame_ms[0], frame_ms[n_frames / 2],
+               frame_ms[(u32)(n_frames * 0.95f)], frame_ms[(u32)(n_frames * 0.99f)], frame_ms[n_frames - 1]);
+    } else {
+        printf("Capture '%s' contains no frames\n", capture_path);
+    }
+
+    if (csv != NULL) SDL_RWclose(csv);
+    free(frame_ms);
+    capture_reader_close(&reader);
+    teardown_window();
+
+    return 0;
+}
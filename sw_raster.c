@@ -0,0 +1,834 @@
+#include "sw_raster.h"
+
+#include <SDL.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SW_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+#define TILE_SIZE 32
+#define SUBPIXEL_BITS 4
+#define SUBPIXEL_ONE (1 << SUBPIXEL_BITS)
+#define MAX_WORKERS 64
+#define PREALLOC_TRIANGLES 1024
+
+// Triangles are clipped to this many pixels outside of the framebuffer and the framebuffer
+// is limited to MAX_SIZE, so edge functions stay within 32 bit inside a tile
+#define GUARD_BAND 4096
+#define MAX_CLIPPED_VERTICES 7 // a triangle clipped by the four guard band edges
+#define MAX_SIZE 8192
+#define EDGE_CLAMP (1 << 30)
+
+// Internal types
+typedef enum {
+    FILL_SOLID,
+    FILL_TEXT,  // font texture, alpha blended
+    FILL_SHAPE, // analytic shape covered by the triangle, alpha blended by the distance to its edge
+} fill_mode;
+
+typedef struct {
+    float2 p[3];   // shape points for FILL_SHAPE
+    float2 uv[3];  // params of the shape in uv[0] for FILL_SHAPE
+    float3 col;
+    fill_mode fill;
+    u32 shape_kind;
+    u32 projection; // slot, see sw_set_projection
+} sw_input_triangle;
+
+typedef struct {
+    sw_input_triangle *data;
+    u32 count;
+    u32 capacity;
+} sw_triangle_list;
+
+// Triangle after setup, edge functions in fixed point:
+//   E(x, y) = step_x * x + step_y * y + origin, evaluated at pixel centers
+//   a pixel is covered if all three are >= 0 (the top-left fill rule is folded into origin)
+typedef struct {
+    i32 min_x, min_y, max_x, max_y; // pixel bounds, max exclusive
+    i32 step_x[3];
+    i32 step_y[3];
+    int64_t origin[3];
+    fill_mode fill;
+    u32 color;   // packed RGBA8, FILL_SOLID
+    float3 col;  // blended fills
+    float u0, dudx, dudy; // uv planes relative to the center of pixel (0, 0)
+    float v0, dvdx, dvdy;
+    float2 shape_p[3];    // FILL_SHAPE in framebuffer pixels
+    float2 shape_params;
+    u32 shape_kind;
+} sw_triangle;
+
+typedef struct {
+    int width;
+    int height;
+    rgba *framebuffer;
+
+    float2 projection_scale[SW_MAX_PROJECTIONS];
+    float2 projection_offset[SW_MAX_PROJECTIONS];
+    u32 projection; // selected slot
+
+    rgba *font;
+    u32 font_width;
+    u32 font_height;
+
+    // All fills in one list, so they are drawn in submission order
+    sw_triangle_list triangles;
+    u32 rendered_triangles; // already in the framebuffer, see sw_render
+    sw_triangle *setup;
+    u32 n_setup;
+    u32 setup_capacity;
+
+    // Triangle indices per tile, in submission order
+    u32 *bin_offsets; // n_tiles + 1 entries
+    u32 *bin_items;
+    u32 bin_capacity;
+
+    bool clear;
+    u32 clear_color;
+
+    int tiles_x;
+    int tiles_y;
+    SDL_Thread *workers[MAX_WORKERS];
+    int n_workers;
+    SDL_sem *work_ready;
+    SDL_sem *work_done;
+    SDL_atomic_t next_tile;
+    bool quit;
+} sw_state;
+
+// Internal globals / state
+static sw_state g_sw;
+
+// =====================================================
+// =============== HELPERS
+// =====================================================
+
+static unsigned char to_unorm8(float f)
+{
+    if (f <= 0.f) return 0;
+    if (f >= 1.f) return 255;
+    return (unsigned char)(f * 255.f + 0.5f);
+}
+
+static u32 pack_rgba(float r, float g, float b, float a)
+{
+    rgba c = { to_unorm8(r), to_unorm8(g), to_unorm8(b), to_unorm8(a) };
+    u32 packed;
+    memcpy(&packed, &c, sizeof(packed));
+    return packed;
+}
+
+static i32 clampi(i32 v, i32 lo, i32 hi)
+{
+    return v < lo ? lo : (v > hi ? hi : v);
+}
+
+static void push_triangle(sw_triangle_list *list, const sw_input_triangle *tri)
+{
+    if (list->count == list->capacity)
+    {
+        list->capacity = list->capacity ? list->capacity * 2 : PREALLOC_TRIANGLES;
+        list->data = realloc(list->data, list->capacity * sizeof(sw_input_triangle));
+        if (list->data == NULL)
+        {
+            printf("Software rasterizer: out of memory\n");
+            abort();
+        }
+    }
+    list->data[list->count++] = *tri;
+}
+
+// =====================================================
+// =============== TRIANGLE SETUP
+// =====================================================
+
+// Vertex in framebuffer pixels, y pointing down like the framebuffer rows
+typedef struct {
+    float2 p;
+    float2 uv;
+} clip_vertex;
+
+// One Sutherland-Hodgman step: keeps the part of the polygon where sign * (p[axis] - bound) <= 0
+static int clip_polygon(const clip_vertex *in, int n, clip_vertex *out, int axis, float bound, float sign)
+{
+    int n_out = 0;
+    for (int i = 0; i < n; i++)
+    {
+        const clip_vertex *a = &in[i];
+        const clip_vertex *b = &in[(i + 1) % n];
+        float da = sign * ((axis == 0 ? a->p.x : a->p.y) - bound);
+        float db = sign * ((axis == 0 ? b->p.x : b->p.y) - bound);
+        if (da <= 0.f) out[n_out++] = *a;
+        if ((da <= 0.f) != (db <= 0.f))
+        {
+            float t = da / (da - db);
+            clip_vertex *v = &out[n_out++];
+            v->p = FLOAT2(a->p.x + (b->p.x - a->p.x) * t, a->p.y + (b->p.y - a->p.y) * t);
+            v->uv = FLOAT2(a->uv.x + (b->uv.x - a->uv.x) * t, a->uv.y + (b->uv.y - a->uv.y) * t);
+        }
+    }
+    return n_out;
+}
+
+// Vertices inside the guard band are snapped to subpixels
+static bool setup_clipped_triangle(const clip_vertex *v0, const clip_vertex *v1, const clip_vertex *v2,
+                                   float3 col, fill_mode fill, sw_triangle *out)
+{
+    const clip_vertex *v[3] = { v0, v1, v2 };
+    i32 x[3], y[3];
+    float2 uv[3], attrib_p[3];
+    for (int i = 0; i < 3; i++)
+    {
+        x[i] = (i32)floorf(v[i]->p.x * SUBPIXEL_ONE + 0.5f);
+        y[i] = (i32)floorf(v[i]->p.y * SUBPIXEL_ONE + 0.5f);
+        uv[i] = v[i]->uv;
+        attrib_p[i] = v[i]->p; // attributes are interpolated from the exact positions, like GL
+    }
+
+    // Make the winding consistent so the inside is where all edge functions are positive
+    int64_t area = (int64_t)(x[1] - x[0]) * (y[2] - y[0]) - (int64_t)(y[1] - y[0]) * (x[2] - x[0]);
+    if (area == 0) return false;
+    if (area < 0)
+    {
+        i32 tx = x[1]; x[1] = x[2]; x[2] = tx;
+        i32 ty = y[1]; y[1] = y[2]; y[2] = ty;
+        float2 tuv = uv[1]; uv[1] = uv[2]; uv[2] = tuv;
+        float2 tp = attrib_p[1]; attrib_p[1] = attrib_p[2]; attrib_p[2] = tp;
+    }
+
+    // Bounding box in pixels, pixel centers are at (x + 0.5, y + 0.5)
+    i32 min_x = x[0], max_x = x[0], min_y = y[0], max_y = y[0];
+    for (int i = 1; i < 3; i++)
+    {
+        if (x[i] < min_x) min_x = x[i];
+        if (x[i] > max_x) max_x = x[i];
+        if (y[i] < min_y) min_y = y[i];
+        if (y[i] > max_y) max_y = y[i];
+    }
+    out->min_x = clampi((min_x - SUBPIXEL_ONE / 2) >> SUBPIXEL_BITS, 0, g_sw.width);
+    out->min_y = clampi((min_y - SUBPIXEL_ONE / 2) >> SUBPIXEL_BITS, 0, g_sw.height);
+    out->max_x = clampi(((max_x - SUBPIXEL_ONE / 2) >> SUBPIXEL_BITS) + 1, 0, g_sw.width);
+    out->max_y = clampi(((max_y - SUBPIXEL_ONE / 2) >> SUBPIXEL_BITS) + 1, 0, g_sw.height);
+    if (out->min_x >= out->max_x || out->min_y >= out->max_y) return false;
+
+    for (int i = 0; i < 3; i++)
+    {
+        int j = (i + 1) % 3;
+        i32 dx = x[j] - x[i];
+        i32 dy = y[j] - y[i];
+        out->step_x[i] = -dy * SUBPIXEL_ONE;
+        out->step_y[i] = dx * SUBPIXEL_ONE;
+        out->origin[i] = (int64_t)dx * (SUBPIXEL_ONE / 2 - y[i]) - (int64_t)dy * (SUBPIXEL_ONE / 2 - x[i]);
+
+        // Top-left rule: pixels exactly on an edge only belong to the triangle
+        // if it's a top or left edge, so shared edges are never drawn twice
+        bool top_left = (dy == 0 && dx > 0) || dy < 0;
+        if (!top_left) out->origin[i] -= 1;
+    }
+
+    out->fill = fill;
+    out->color = pack_rgba(col.x, col.y, col.z, 1.f);
+    out->col = col;
+
+    if (fill == FILL_TEXT)
+    {
+        float x0 = attrib_p[0].x, y0 = attrib_p[0].y;
+        float x1 = attrib_p[1].x - x0, y1 = attrib_p[1].y - y0;
+        float x2 = attrib_p[2].x - x0, y2 = attrib_p[2].y - y0;
+        float inv_area = 1.f / (x1 * y2 - x2 * y1);
+
+        float du1 = uv[1].x - uv[0].x, du2 = uv[2].x - uv[0].x;
+        float dv1 = uv[1].y - uv[0].y, dv2 = uv[2].y - uv[0].y;
+        out->dudx = (du1 * y2 - du2 * y1) * inv_area;
+        out->dudy = (du2 * x1 - du1 * x2) * inv_area;
+        out->dvdx = (dv1 * y2 - dv2 * y1) * inv_area;
+        out->dvdy = (dv2 * x1 - dv1 * x2) * inv_area;
+        out->u0 = uv[0].x + out->dudx * (0.5f - x0) + out->dudy * (0.5f - y0);
+        out->v0 = uv[0].y + out->dvdx * (0.5f - x0) + out->dvdy * (0.5f - y0);
+    }
+    return true;
+}
+
+static sw_triangle *next_setup()
+{
+    if (g_sw.n_setup == g_sw.setup_capacity)
+    {
+        g_sw.setup_capacity = g_sw.setup_capacity ? g_sw.setup_capacity * 2 : PREALLOC_TRIANGLES;
+        g_sw.setup = realloc(g_sw.setup, g_sw.setup_capacity * sizeof(sw_triangle));
+        if (g_sw.setup == NULL)
+        {
+            printf("Software rasterizer: out of memory\n");
+            abort();
+        }
+    }
+    return &g_sw.setup[g_sw.n_setup];
+}
+
+// Projection -> NDC -> framebuffer pixels
+static float2 to_pixels(float2 p, u32 projection)
+{
+    float2 scale = g_sw.projection_scale[projection];
+    float2 offset = g_sw.projection_offset[projection];
+    float nx = p.x * scale.x + offset.x;
+    float ny = p.y * scale.y + offset.y;
+    return FLOAT2((nx + 1.f) * 0.5f * g_sw.width, (1.f - ny) * 0.5f * g_sw.height);
+}
+
+// Clips a triangle in pixels and appends its setup. Like GL, triangles reaching past the guard band
+// are clipped to it (and fanned back into triangles) instead of moving their vertices, which would
+// bend the visible edges.
+static void setup_pixel_triangle(clip_vertex *poly, float3 col, fill_mode fill, const sw_triangle *shape)
+{
+    const float w = (float)g_sw.width;
+    const float h = (float)g_sw.height;
+
+    bool inside = true;
+    for (int i = 0; i < 3; i++)
+    {
+        inside = inside && poly[i].p.x >= -GUARD_BAND && poly[i].p.x <= w + GUARD_BAND
+                        && poly[i].p.y >= -GUARD_BAND && poly[i].p.y <= h + GUARD_BAND;
+    }
+
+    int n = 3;
+    if (!inside)
+    {
+        clip_vertex tmp[MAX_CLIPPED_VERTICES];
+        n = clip_polygon(poly, n, tmp, 0, -GUARD_BAND, -1.f);
+        n = clip_polygon(tmp, n, poly, 0, w + GUARD_BAND, 1.f);
+        n = clip_polygon(poly, n, tmp, 1, -GUARD_BAND, -1.f);
+        n = clip_polygon(tmp, n, poly, 1, h + GUARD_BAND, 1.f);
+    }
+
+    for (int i = 1; i + 1 < n; i++)
+    {
+        sw_triangle *out = next_setup();
+        if (!setup_clipped_triangle(&poly[0], &poly[i], &poly[i + 1], col, fill, out)) continue;
+        if (shape != NULL)
+        {
+            memcpy(out->shape_p, shape->shape_p, sizeof(out->shape_p));
+            out->shape_params = shape->shape_params;
+            out->shape_kind = shape->shape_kind;
+        }
+        g_sw.n_setup++;
+    }
+}
+
+static void setup_triangle(const sw_input_triangle *in)
+{
+    clip_vertex poly[MAX_CLIPPED_VERTICES];
+    for (int i = 0; i < 3; i++)
+    {
+        poly[i].p = to_pixels(in->p[i], in->projection);
+        poly[i].uv = in->uv[i];
+    }
+    setup_pixel_triangle(poly, in->col, in->fill, NULL);
+}
+
+// Quad around the shape with one pixel for the coverage ramp, same as the GL shape vertex shader
+static void setup_shape(const sw_input_triangle *in)
+{
+    sw_triangle shape;
+    for (int i = 0; i < 3; i++) shape.shape_p[i] = to_pixels(in->p[i], in->projection);
+    shape.shape_params = in->uv[0];
+    shape.shape_kind = in->shape_kind;
+
+    const float2 *p = shape.shape_p;
+    float2 params = shape.shape_params;
+    float2 corners[4];
+    if (in->shape_kind == SW_SHAPE_LINE)
+    {
+        float e = params.x * 0.5f + 1.f;
+        float2 d = FLOAT2(p[1].x - p[0].x, p[1].y - p[0].y);
+        float len = sqrtf(d.x * d.x + d.y * d.y);
+        float2 dir = len > 0.f ? FLOAT2(d.x / len, d.y / len) : FLOAT2(1.f, 0.f);
+        float2 n = FLOAT2(-dir.y, dir.x);
+        float2 mid = FLOAT2((p[0].x + p[1].x) * 0.5f, (p[0].y + p[1].y) * 0.5f);
+        for (int i = 0; i < 4; i++)
+        {
+            float cx = (i == 1 || i == 2) ? 1.f : -1.f;
+            float cy = i >= 2 ? 1.f : -1.f;
+            corners[i] = FLOAT2(mid.x + dir.x * cx * (len * 0.5f + e) + n.x * cy * e,
+                                mid.y + dir.y * cx * (len * 0.5f + e) + n.y * cy * e);
+        }
+    }
+    else
+    {
+        float2 lo, hi;
+        if (in->shape_kind == SW_SHAPE_RING)
+        {
+            lo = FLOAT2(p[0].x - params.x - 1.f, p[0].y - params.x - 1.f);
+            hi = FLOAT2(p[0].x + params.x + 1.f, p[0].y + params.x + 1.f);
+        }
+        else
+        {
+            lo = FLOAT2(fminf(fminf(p[0].x, p[1].x), p[2].x) - 1.f, fminf(fminf(p[0].y, p[1].y), p[2].y) - 1.f);
+            hi = FLOAT2(fmaxf(fmaxf(p[0].x, p[1].x), p[2].x) + 1.f, fmaxf(fmaxf(p[0].y, p[1].y), p[2].y) + 1.f);
+        }
+        corners[0] = lo;
+        corners[1] = FLOAT2(hi.x, lo.y);
+        corners[2] = hi;
+        corners[3] = FLOAT2(lo.x, hi.y);
+    }
+
+    clip_vertex poly[MAX_CLIPPED_VERTICES];
+    memset(poly, 0, sizeof(poly));
+    poly[0].p = corners[0]; poly[1].p = corners[1]; poly[2].p = corners[2];
+    setup_pixel_triangle(poly, in->col, FILL_SHAPE, &shape);
+    memset(poly, 0, sizeof(poly));
+    poly[0].p = corners[2]; poly[1].p = corners[3]; poly[2].p = corners[0];
+    setup_pixel_triangle(poly, in->col, FILL_SHAPE, &shape);
+}
+
+// =====================================================
+// =============== SHADING
+// =====================================================
+
+// Bilinear filtering with clamp to edge, matching GL_LINEAR + GL_CLAMP_TO_EDGE
+static void sample_font(float u, float v, float out[4])
+{
+    float fx = u * g_sw.font_width - 0.5f;
+    float fy = v * g_sw.font_height - 0.5f;
+    float x0f = floorf(fx), y0f = floorf(fy);
+    float wx = fx - x0f, wy = fy - y0f;
+
+    i32 max_x = (i32)g_sw.font_width - 1, max_y = (i32)g_sw.font_height - 1;
+    i32 x0 = clampi((i32)x0f, 0, max_x), x1 = clampi((i32)x0f + 1, 0, max_x);
+    i32 y0 = clampi((i32)y0f, 0, max_y), y1 = clampi((i32)y0f + 1, 0, max_y);
+
+    const unsigned char *t00 = &g_sw.font[y0 * g_sw.font_width + x0].r;
+    const unsigned char *t10 = &g_sw.font[y0 * g_sw.font_width + x1].r;
+    const unsigned char *t01 = &g_sw.font[y1 * g_sw.font_width + x0].r;
+    const unsigned char *t11 = &g_sw.font[y1 * g_sw.font_width + x1].r;
+    for (int c = 0; c < 4; c++)
+    {
+        float top = t00[c] + (t10[c] - t00[c]) * wx;
+        float bottom = t01[c] + (t11[c] - t01[c]) * wx;
+        out[c] = (top + (bottom - top) * wy) * (1.f / 255.f);
+    }
+}
+
+// outColor = vec4(col, 1) * texture(font, uv), blended with GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA
+static void shade_text_pixel(const sw_triangle *tri, i32 x, i32 y, rgba *dst)
+{
+    if (g_sw.font == NULL) return;
+
+    float tex[4];
+    sample_font(tri->u0 + tri->dudx * x + tri->dudy * y, tri->v0 + tri->dvdx * x + tri->dvdy * y, tex);
+
+    float a = tex[3];
+    float ia = 1.f - a;
+    dst->r = to_unorm8(tri->col.x * tex[0] * a + dst->r * (1.f / 255.f) * ia);
+    dst->g = to_unorm8(tri->col.y * tex[1] * a + dst->g * (1.f / 255.f) * ia);
+    dst->b = to_unorm8(tri->col.z * tex[2] * a + dst->b * (1.f / 255.f) * ia);
+    dst->a = to_unorm8(a * a + dst->a * (1.f / 255.f) * ia);
+}
+
+static float dot2(float2 a, float2 b)
+{
+    return a.x * b.x + a.y * b.y;
+}
+
+static float clampf(float v, float lo, float hi)
+{
+    return v < lo ? lo : (v > hi ? hi : v);
+}
+
+static float sd_segment(float2 p, float2 a, float2 b)
+{
+    float2 pa = FLOAT2(p.x - a.x, p.y - a.y), ba = FLOAT2(b.x - a.x, b.y - a.y);
+    float h = clampf(dot2(pa, ba) / fmaxf(dot2(ba, ba), 1e-8f), 0.f, 1.f);
+    float2 d = FLOAT2(pa.x - ba.x * h, pa.y - ba.y * h);
+    return sqrtf(dot2(d, d));
+}
+
+// Works for both windings
+static float sd_triangle(float2 p, const float2 *t)
+{
+    float dist = 1e30f;
+    float inside = 1.f;
+    float2 e0 = FLOAT2(t[1].x - t[0].x, t[1].y - t[0].y);
+    float2 e2 = FLOAT2(t[0].x - t[2].x, t[0].y - t[2].y);
+    float s = e0.x * e2.y - e0.y * e2.x > 0.f ? 1.f : -1.f;
+    for (int i = 0; i < 3; i++)
+    {
+        float2 a = t[i], b = t[(i + 1) % 3];
+        float2 e = FLOAT2(b.x - a.x, b.y - a.y);
+        float2 v = FLOAT2(p.x - a.x, p.y - a.y);
+        float h = clampf(dot2(v, e) / fmaxf(dot2(e, e), 1e-8f), 0.f, 1.f);
+        float2 pq = FLOAT2(v.x - e.x * h, v.y - e.y * h);
+        dist = fminf(dist, dot2(pq, pq));
+        inside = fminf(inside, s * (v.x * e.y - v.y * e.x));
+    }
+    return inside > 0.f ? -sqrtf(dist) : sqrtf(dist);
+}
+
+// Same distance functions and one pixel wide coverage ramp as the GL shape shaders
+static void shade_shape_pixel(const sw_triangle *tri, i32 x, i32 y, rgba *dst)
+{
+    float2 p = FLOAT2(x + 0.5f, y + 0.5f);
+    float d;
+    if (tri->shape_kind == SW_SHAPE_LINE)
+    {
+        d = sd_segment(p, tri->shape_p[0], tri->shape_p[1]) - tri->shape_params.x * 0.5f;
+    }
+    else if (tri->shape_kind == SW_SHAPE_RING)
+    {
+        float mid = (tri->shape_params.x + tri->shape_params.y) * 0.5f;
+        float half_width = (tri->shape_params.x - tri->shape_params.y) * 0.5f;
+        float2 v = FLOAT2(p.x - tri->shape_p[0].x, p.y - tri->shape_p[0].y);
+        d = fabsf(sqrtf(dot2(v, v)) - mid) - half_width;
+    }
+    else
+    {
+        d = sd_triangle(p, tri->shape_p);
+    }
+
+    float a = clampf(0.5f - d, 0.f, 1.f);
+    if (a <= 0.f) return;
+    float ia = 1.f - a;
+    dst->r = to_unorm8(tri->col.x * a + dst->r * (1.f / 255.f) * ia);
+    dst->g = to_unorm8(tri->col.y * a + dst->g * (1.f / 255.f) * ia);
+    dst->b = to_unorm8(tri->col.z * a + dst->b * (1.f / 255.f) * ia);
+    dst->a = to_unorm8(a * a + dst->a * (1.f / 255.f) * ia);
+}
+
+static void shade_pixel(const sw_triangle *tri, i32 x, i32 y, rgba *dst)
+{
+    if (tri->fill == FILL_TEXT) shade_text_pixel(tri, x, y, dst);
+    else if (tri->fill == FILL_SHAPE) shade_shape_pixel(tri, x, y, dst);
+    else memcpy(dst, &tri->color, sizeof(u32));
+}
+
+// =====================================================
+// =============== RASTERIZATION
+// =====================================================
+
+static void raster_triangle(const sw_triangle *tri, i32 x0, i32 y0, i32 x1, i32 y1)
+{
+    // Edge values at the first pixel. Within a tile an edge changes by less than EDGE_CLAMP / 2,
+    // so far away edges either reject the whole tile or can be clamped without changing any sign.
+    i32 row[3];
+    for (int i = 0; i < 3; i++)
+    {
+        int64_t e = tri->origin[i] + (int64_t)tri->step_x[i] * x0 + (int64_t)tri->step_y[i] * y0;
+        if (e < -EDGE_CLAMP) return;
+        row[i] = (i32)(e > EDGE_CLAMP ? EDGE_CLAMP : e);
+    }
+
+#ifdef SW_USE_SSE2
+    const __m128i lane = _mm_setr_epi32(0, 1, 2, 3);
+    __m128i step4[3], lane_offset[3];
+    for (int i = 0; i < 3; i++)
+    {
+        step4[i] = _mm_set1_epi32(tri->step_x[i] * 4);
+        // step_x * lane without SSE4.1 multiplies
+        __m128i s = _mm_set1_epi32(tri->step_x[i]);
+        lane_offset[i] = _mm_add_epi32(_mm_and_si128(s, _mm_cmpgt_epi32(lane, _mm_setzero_si128())),
+                         _mm_add_epi32(_mm_and_si128(s, _mm_cmpgt_epi32(lane, _mm_set1_epi32(1))),
+                                       _mm_and_si128(s, _mm_cmpgt_epi32(lane, _mm_set1_epi32(2)))));
+    }
+    const __m128i color4 = _mm_set1_epi32((int)tri->color);
+#endif
+
+    for (i32 y = y0; y < y1; y++)
+    {
+        rgba *dst_row = g_sw.framebuffer + (size_t)y * g_sw.width;
+
+#ifdef SW_USE_SSE2
+        __m128i e0 = _mm_add_epi32(_mm_set1_epi32(row[0]), lane_offset[0]);
+        __m128i e1 = _mm_add_epi32(_mm_set1_epi32(row[1]), lane_offset[1]);
+        __m128i e2 = _mm_add_epi32(_mm_set1_epi32(row[2]), lane_offset[2]);
+        for (i32 x = x0; x < x1; x += 4)
+        {
+            // Sign bit set in any edge -> outside
+            __m128i any = _mm_or_si128(_mm_or_si128(e0, e1), e2);
+            int mask = ~_mm_movemask_ps(_mm_castsi128_ps(any)) & 0xF;
+            i32 n = x1 - x < 4 ? x1 - x : 4;
+            mask &= (1 << n) - 1;
+
+            if (mask == 0xF && tri->fill == FILL_SOLID)
+            {
+                _mm_storeu_si128((__m128i *)(dst_row + x), color4);
+            }
+            else if (mask != 0)
+            {
+                for (int l = 0; l < n; l++)
+                {
+                    if (!(mask & (1 << l))) continue;
+                    shade_pixel(tri, x + l, y, dst_row + x + l);
+                }
+            }
+
+            e0 = _mm_add_epi32(e0, step4[0]);
+            e1 = _mm_add_epi32(e1, step4[1]);
+            e2 = _mm_add_epi32(e2, step4[2]);
+        }
+#else
+        i32 e0 = row[0], e1 = row[1], e2 = row[2];
+        for (i32 x = x0; x < x1; x++)
+        {
+            if ((e0 | e1 | e2) >= 0)
+            {
+                shade_pixel(tri, x, y, dst_row + x);
+            }
+            e0 += tri->step_x[0];
+            e1 += tri->step_x[1];
+            e2 += tri->step_x[2];
+        }
+#endif
+
+        row[0] += tri->step_y[0];
+        row[1] += tri->step_y[1];
+        row[2] += tri->step_y[2];
+    }
+}
+
+static void raster_tile(int tile)
+{
+    i32 tx0 = (tile % g_sw.tiles_x) * TILE_SIZE;
+    i32 ty0 = (tile / g_sw.tiles_x) * TILE_SIZE;
+    i32 tx1 = tx0 + TILE_SIZE < g_sw.width ? tx0 + TILE_SIZE : g_sw.width;
+    i32 ty1 = ty0 + TILE_SIZE < g_sw.height ? ty0 + TILE_SIZE : g_sw.height;
+
+    if (g_sw.clear)
+    {
+        for (i32 y = ty0; y < ty1; y++)
+        {
+            u32 *dst = (u32 *)(g_sw.framebuffer + (size_t)y * g_sw.width);
+            for (i32 x = tx0; x < tx1; x++) dst[x] = g_sw.clear_color;
+        }
+    }
+
+    // Every tile walks its triangles in submission order, so the result is deterministic
+    // no matter which thread renders which tile
+    for (u32 i = g_sw.bin_offsets[tile]; i < g_sw.bin_offsets[tile + 1]; i++)
+    {
+        const sw_triangle *tri = &g_sw.setup[g_sw.bin_items[i]];
+        i32 x0 = tri->min_x > tx0 ? tri->min_x : tx0;
+        i32 y0 = tri->min_y > ty0 ? tri->min_y : ty0;
+        i32 x1 = tri->max_x < tx1 ? tri->max_x : tx1;
+        i32 y1 = tri->max_y < ty1 ? tri->max_y : ty1;
+        raster_triangle(tri, x0, y0, x1, y1);
+    }
+}
+
+// Counting sort of the triangles into the tiles their bounding box touches
+static void bin_triangles()
+{
+    int n_tiles = g_sw.tiles_x * g_sw.tiles_y;
+    memset(g_sw.bin_offsets, 0, (n_tiles + 1) * sizeof(u32));
+
+    u32 total = 0;
+    for (u32 i = 0; i < g_sw.n_setup; i++)
+    {
+        const sw_triangle *tri = &g_sw.setup[i];
+        for (i32 ty = tri->min_y / TILE_SIZE; ty <= (tri->max_y - 1) / TILE_SIZE; ty++)
+        {
+            for (i32 tx = tri->min_x / TILE_SIZE; tx <= (tri->max_x - 1) / TILE_SIZE; tx++)
+            {
+                g_sw.bin_offsets[ty * g_sw.tiles_x + tx + 1]++;
+                total++;
+            }
+        }
+    }
+
+    if (total > g_sw.bin_capacity)
+    {
+        g_sw.bin_capacity = total;
+        free(g_sw.bin_items);
+        g_sw.bin_items = malloc(total * sizeof(u32));
+    }
+
+    for (int t = 0; t < n_tiles; t++) g_sw.bin_offsets[t + 1] += g_sw.bin_offsets[t];
+
+    // Temporarily use offsets as write cursors, shifted back afterwards
+    for (u32 i = 0; i < g_sw.n_setup; i++)
+    {
+        const sw_triangle *tri = &g_sw.setup[i];
+        for (i32 ty = tri->min_y / TILE_SIZE; ty <= (tri->max_y - 1) / TILE_SIZE; ty++)
+        {
+            for (i32 tx = tri->min_x / TILE_SIZE; tx <= (tri->max_x - 1) / TILE_SIZE; tx++)
+            {
+                g_sw.bin_items[g_sw.bin_offsets[ty * g_sw.tiles_x + tx]++] = i;
+            }
+        }
+    }
+    for (int t = n_tiles; t > 0; t--) g_sw.bin_offsets[t] = g_sw.bin_offsets[t - 1];
+    g_sw.bin_offsets[0] = 0;
+}
+
+static void raster_tiles()
+{
+    int n_tiles = g_sw.tiles_x * g_sw.tiles_y;
+    for (;;)
+    {
+        int tile = SDL_AtomicAdd(&g_sw.next_tile, 1);
+        if (tile >= n_tiles) break;
+        raster_tile(tile);
+    }
+}
+
+static int worker_main(void *arg)
+{
+    (void)arg;
+    for (;;)
+    {
+        SDL_SemWait(g_sw.work_ready);
+        if (g_sw.quit) break;
+        raster_tiles();
+        SDL_SemPost(g_sw.work_done);
+    }
+    return 0;
+}
+
+// =====================================================
+// =============== PUBLIC API
+// =====================================================
+
+static void alloc_framebuffer(int width, int height)
+{
+    if (width <= 0 || height <= 0 || width > MAX_SIZE || height > MAX_SIZE)
+    {
+        printf("Software rasterizer: unsupported framebuffer size %dx%d\n", width, height);
+        abort();
+    }
+
+    free(g_sw.framebuffer);
+    free(g_sw.bin_offsets);
+    g_sw.width = width;
+    g_sw.height = height;
+    g_sw.framebuffer = calloc((size_t)width * height, sizeof(rgba));
+    g_sw.tiles_x = (width + TILE_SIZE - 1) / TILE_SIZE;
+    g_sw.tiles_y = (height + TILE_SIZE - 1) / TILE_SIZE;
+    g_sw.bin_offsets = malloc((g_sw.tiles_x * g_sw.tiles_y + 1) * sizeof(u32));
+}
+
+void sw_init(int width, int height)
+{
+    memset(&g_sw, 0, sizeof(g_sw));
+    alloc_framebuffer(width, height);
+    for (int i = 0; i < SW_MAX_PROJECTIONS; i++) g_sw.projection_scale[i] = FLOAT2(1.f, 1.f);
+
+    // The calling thread renders tiles too
+    g_sw.n_workers = SDL_GetCPUCount() - 1;
+    if (g_sw.n_workers < 0) g_sw.n_workers = 0;
+    if (g_sw.n_workers > MAX_WORKERS) g_sw.n_workers = MAX_WORKERS;
+
+    g_sw.work_ready = SDL_CreateSemaphore(0);
+    g_sw.work_done = SDL_CreateSemaphore(0);
+    for (int i = 0; i < g_sw.n_workers; i++)
+    {
+        g_sw.workers[i] = SDL_CreateThread(worker_main, "sw_raster", NULL);
+        if (g_sw.workers[i] == NULL)
+        {
+            g_sw.n_workers = i;
+            break;
+        }
+    }
+}
+
+void sw_shutdown()
+{
+    g_sw.quit = true;
+    for (int i = 0; i < g_sw.n_workers; i++) SDL_SemPost(g_sw.work_ready);
+    for (int i = 0; i < g_sw.n_workers; i++) SDL_WaitThread(g_sw.workers[i], NULL);
+    SDL_DestroySemaphore(g_sw.work_ready);
+    SDL_DestroySemaphore(g_sw.work_done);
+
+    free(g_sw.framebuffer);
+    free(g_sw.font);
+    free(g_sw.triangles.data);
+    free(g_sw.setup);
+    free(g_sw.bin_offsets);
+    free(g_sw.bin_items);
+    memset(&g_sw, 0, sizeof(g_sw));
+}
+
+void sw_resize(int width, int height)
+{
+    if (width == g_sw.width && height == g_sw.height) return;
+
+    // The old pixels don't map onto the new size, the retained triangles are drawn again instead
+    alloc_framebuffer(width, height);
+    g_sw.rendered_triangles = 0;
+    g_sw.clear = true;
+}
+
+void sw_set_font(const void *pixels, u32 width, u32 height)
+{
+    free(g_sw.font);
+    g_sw.font = malloc((size_t)width * height * sizeof(rgba));
+    memcpy(g_sw.font, pixels, (size_t)width * height * sizeof(rgba));
+    g_sw.font_width = width;
+    g_sw.font_height = height;
+}
+
+void sw_set_projection(u32 slot, float2 scale, float2 offset)
+{
+    g_sw.projection_scale[slot] = scale;
+    g_sw.projection_offset[slot] = offset;
+}
+
+void sw_select_projection(u32 slot)
+{
+    g_sw.projection = slot;
+}
+
+void sw_clear(float3 col)
+{
+    g_sw.triangles.count = 0;
+    g_sw.rendered_triangles = 0;
+    g_sw.clear = true;
+    g_sw.clear_color = pack_rgba(col.x, col.y, col.z, 1.f);
+}
+
+void sw_push_triangle(float2 a, float2 b, float2 c, float3 col)
+{
+    sw_input_triangle tri = { { a, b, c }, { { 0, 0 }, { 0, 0 }, { 0, 0 } }, col, FILL_SOLID, 0, g_sw.projection };
+    push_triangle(&g_sw.triangles, &tri);
+}
+
+void sw_push_shape(u32 kind, float2 p0, float2 p1, float2 p2, float2 params, float3 col)
+{
+    sw_input_triangle shape = { { p0, p1, p2 }, { params, { 0, 0 }, { 0, 0 } }, col, FILL_SHAPE, kind, g_sw.projection };
+    push_triangle(&g_sw.triangles, &shape);
+}
+
+void sw_push_text_triangle(float2 a, float2 b, float2 c, float2 uv_a, float2 uv_b, float2 uv_c, float3 col)
+{
+    sw_input_triangle tri = { { a, b, c }, { uv_a, uv_b, uv_c }, col, FILL_TEXT, 0, g_sw.projection };
+    push_triangle(&g_sw.triangles, &tri);
+}
+
+void sw_render()
+{
+    // Setup once per frame, shared read-only by all tiles
+    g_sw.n_setup = 0;
+    for (u32 i = g_sw.rendered_triangles; i < g_sw.triangles.count; i++)
+    {
+        const sw_input_triangle *tri = &g_sw.triangles.data[i];
+        if (tri->fill == FILL_SHAPE) setup_shape(tri);
+        else setup_triangle(tri);
+    }
+    g_sw.rendered_triangles = g_sw.triangles.count;
+
+    bin_triangles();
+
+    SDL_AtomicSet(&g_sw.next_tile, 0);
+    for (int i = 0; i < g_sw.n_workers; i++) SDL_SemPost(g_sw.work_ready);
+    raster_tiles();
+    for (int i = 0; i < g_sw.n_workers; i++) SDL_SemWait(g_sw.work_done);
+
+    g_sw.clear = false;
+}
+
+const rgba *sw_framebuffer()
+{
+    return g_sw.framebuffer;
+}
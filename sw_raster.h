@@ -0,0 +1,48 @@
+#ifndef SW_RASTER_H
+#define SW_RASTER_H
+
+#include "linalg.h"
+
+// CPU rasterizer used by the software render backend.
+// Mirrors the GL pipeline of render2d: solid triangles, antialiased shapes and alpha blended
+// text are all drawn in submission order, whatever their kind.
+// The framebuffer is split into tiles that are rasterized in parallel by a worker pool,
+// coverage is computed with fixed point edge functions, 4 pixels at a time with SSE2.
+
+void sw_init(int width, int height);
+void sw_shutdown();
+// Reallocates the framebuffer, everything pushed since the last sw_clear is rasterized again
+// by the next sw_render. Does nothing if the size doesn't change.
+void sw_resize(int width, int height);
+
+// Copies the RGBA8 font bitmap, sampled bilinear with clamp to edge like the GL backend
+void sw_set_font(const void *pixels, u32 width, u32 height);
+
+// Pushed positions are mapped to normalized device coordinates as p * scale + offset when
+// they are rasterized, like the projection uniform of the GL backend. Each push keeps the slot
+// selected at the time, so triangles of different coordinate systems mix in one frame.
+// All slots are identity after sw_init, slot 0 is selected.
+#define SW_MAX_PROJECTIONS 2
+void sw_set_projection(u32 slot, float2 scale, float2 offset);
+void sw_select_projection(u32 slot);
+
+void sw_clear(float3 col);
+void sw_push_triangle(float2 a, float2 b, float2 c, float3 col);
+void sw_push_text_triangle(float2 a, float2 b, float2 c, float2 uv_a, float2 uv_b, float2 uv_c, float3 col);
+
+// Analytic shapes with the distance functions of the GL shape shader, params in framebuffer pixels
+enum {
+    SW_SHAPE_LINE,     // p0 -> p1, params.x thickness
+    SW_SHAPE_RING,     // center p0, params outer + inner radius
+    SW_SHAPE_TRIANGLE, // p0, p1, p2
+};
+void sw_push_shape(u32 kind, float2 p0, float2 p1, float2 p2, float2 params, float3 col);
+
+// Rasterizes everything pushed since the last sw_render or sw_clear into the framebuffer,
+// the framebuffer keeps its content between calls
+void sw_render();
+
+// Top-down rows of width*height pixels
+const rgba *sw_framebuffer();
+
+#endif // SW_RASTER_H
@@ -2,12 +2,43 @@
 #include "gl_utils.h"
 #include "render2d.h"
 #include <stdio.h>
+#include <string.h>
+
+#define BOARD_WIDTH 10
+#define BOARD_HEIGHT 20
+
+enum { CELL_EMPTY, CELL_BLOCK, CELL_FALLING };
+
+static tilemap *g_board;
 
 void tick(float dt)
 {
     // printf("Tick: %f	\n", dt);
     clear_screen(GREY);
 
+    // Single falling cell, only the two cells it leaves and enters are uploaded per step
+    static float fall_time = 0.f;
+    static int2 falling = {BOARD_WIDTH / 2, 0};
+    fall_time += dt;
+    if (fall_time > 0.1f)
+    {
+        fall_time = 0.f;
+        int2 below = INT2(falling.x, falling.y + 1);
+        if (below.y < BOARD_HEIGHT && tilemap_get(g_board, below) == CELL_EMPTY)
+        {
+            tilemap_set(g_board, falling, CELL_EMPTY);
+            falling = below;
+            tilemap_set(g_board, falling, CELL_FALLING);
+        }
+        else
+        {
+            tilemap_set(g_board, falling, CELL_BLOCK);
+            falling = INT2((falling.x + 3) % BOARD_WIDTH, 0);
+            tilemap_set(g_board, falling, CELL_FALLING);
+        }
+    }
+    draw_tilemap(g_board, FLOAT2(-0.9f, 0.9f), FLOAT2(0.6f, 1.8f));
+
     const rad rad_per_sec = DEG(90.f);
     static rad angle = 0.0f;
     angle += dt * rad_per_sec;
@@ -22,16 +53,33 @@ void tick(float dt)
 
 int main(int argc, char *argv[])
 {
-    UNUSED(argc);
-    UNUSED(argv);
+    render_backend backend = RENDER_BACKEND_GL;
+    bool pipelined = false;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--software") == 0) backend = RENDER_BACKEND_SOFTWARE;
+        if (strcmp(argv[i], "--pipelined") == 0) pipelined = true;
+    }
 
-    make_window(INT2(100, 100), INT2(800, 600), "2D Render Test");
+    make_window_with_backend(INT2(100, 100), INT2(800, 600), "2D Render Test", backend);
     load_font("../ExportedFont.png");
 
     printf("Hello 2D Render Test!\n");
 
-    main_loop(tick);
+    const float3 palette[] = { BLACK, BLUE, RED };
+    g_board = tilemap_create(INT2(BOARD_WIDTH, BOARD_HEIGHT), palette, 3);
+
+    // Software and pipelined frames draw the board as one quad per cell
+    if (pipelined)
+    {
+        main_loop_pipelined(tick);
+    }
+    else
+    {
+        main_loop(tick);
+    }
 
+    tilemap_destroy(g_board);
     teardown_window();
 
     return 0;